@@ -12,7 +12,7 @@
  * the page directory.
  */
 .text
-.globl _idt,_gdt,_pg_dir,_tmp_floppy_area
+.globl _idt,_gdt,_pg_dir,_tmp_floppy_area,_empty_zero_page
 _pg_dir:                    # 页目录地址
 startup_32:                 # virtual address 0x0000
 	# $0x10, 也是选择子 ==> 10|0|00 第3项|GDT|00特权级 ==> GDT第2项指向内核数据段
@@ -125,6 +125,14 @@ pg2:
 pg3:
 
 .org 0x5000
+/*
+ * empty_zero_page is mapped read-only wherever a task reads anonymous
+ * memory it has never written. It's below LOW_MEM, so it has no count
+ * in mem_map and is never freed.
+ */
+_empty_zero_page:
+
+.org 0x6000
 /*
  * tmp_floppy_area is used by the floppy-driver when DMA cannot
  * reach to a buffer-block. It needs to be aligned, so that it isn't
@@ -197,6 +205,8 @@ ignore_int:
  * I've tried to show which constants to change by having
  * some kind of marker at them (search for "16Mb"), but I
  * won't guarantee that's all :-( )
+ *
+ * Memory above 16Mb is mapped later, by paging_init() in mm/memory.c.
  */
 .align 2
 setup_paging:
@@ -242,7 +252,7 @@ gdt_descr:
 _idt:	.fill 256,8,0		# idt is uninitialized 256项，每项8字节，填0
 
 _gdt:	.quad 0x0000000000000000	/* NULL descriptor */
-	.quad 0x00c09a0000000fff	/* 16Mb 内核代码段, 段选择子 0x8 , 基址0x00000000,限长 0fff 即1000，即 16MB */
-	.quad 0x00c0920000000fff	/* 16Mb 内核数据段, 段选择子 0x10, 基址0x00000000,限长 0fff 即1000，即 16MB */
+	.quad 0x00c39a000000ffff	/* 1Gb 内核代码段, 段选择子 0x8 , 基址0x00000000,限长 3ffff，即 1GB = TASK_BASE */
+	.quad 0x00c392000000ffff	/* 1Gb 内核数据段, 段选择子 0x10, 基址0x00000000,限长 3ffff，即 1GB = TASK_BASE */
 	.quad 0x0000000000000000	/* TEMPORARY - don't use 用于隔离 LDT 和 TSS */
 	.fill 252,8,0			/* space for LDT's and TSS's etc */
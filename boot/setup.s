@@ -52,6 +52,34 @@ start:              ! 拷贝机器系统数据
 	int	0x15
 	mov	[2],ax
 
+! 0x88 can't report more than 64MB. Ask E801 for the memory above 16MB,
+! in 64kB blocks (some BIOSes only fill in dx), 0 if it doesn't know.
+
+	mov	ax,#0xe801
+	xor	bx,bx
+	xor	dx,dx
+	int	0x15
+	jnc	e801ok
+	xor	bx,bx
+	xor	dx,dx
+e801ok:
+	or	bx,bx
+	jnz	e801bx
+	mov	bx,dx
+e801bx:
+	mov	[0x12],bx
+
+! The segment of the extended BIOS data area, where the MP floating
+! pointer may be, is at 0x40E. The page directory goes there later on,
+! so save it for smp_init().
+
+	push	ds
+	xor	ax,ax
+	mov	ds,ax
+	mov	ax,[0x40E]
+	pop	ds
+	mov	[0x14],ax
+
 ! Get video-card data:
 
 	mov	ah,#0x0f
@@ -6,6 +6,7 @@
 
 /* bitmap.c contains the code that handles the inode and block bitmaps */
 #include <string.h>
+#include <stddef.h>
 
 #include <linux/sched.h>
 #include <linux/kernel.h>
@@ -72,27 +73,61 @@ void free_block(int dev, int block)
 	sb->s_zmap[block/8192]->b_dirt = 1;
 }
 
-int new_block(int dev)
+/*
+ * The first zero bit at or after 'nr' in the zone map, below 'size'; -1
+ * if there is none. The map goes on over the s_zmap blocks, 8192 bits
+ * each, so this looks at a long at a time and just carries on.
+ */
+static int find_next_zero(struct super_block * sb, int nr, int size)
+{
+	unsigned long word;
+	int bit;
+
+	while (nr < size) {
+		if (!sb->s_zmap[nr>>13])
+			return -1;
+		word = ~((unsigned long *) sb->s_zmap[nr>>13]->b_data)[(nr&8191)>>5];
+		if ((word >>= (nr&31))) {
+			__asm__("bsfl %1,%0":"=r" (bit):"r" (word));
+			nr += bit;
+			return (nr < size) ? nr : -1;
+		}
+		nr = (nr|31)+1;
+	}
+	return -1;
+}
+
+/*
+ * new_block() looks for a free zone from 'goal' on (the block after the
+ * one before it in the file, see _bmap()), so that a file written in
+ * order is in order on the disk. Without a goal it carries on from
+ * where the last search on this device stopped, s_rotor. Either way it
+ * wraps round to the start of the map if it has to.
+ */
+int new_block(int dev, int goal)
 {
 	struct buffer_head * bh;
 	struct super_block * sb;
-	int i,j;
+	int i,j,size;
 
 	if (!(sb = get_super(dev)))
 		panic("trying to get new block from nonexistant device");
-	j = 8192;
-	for (i=0 ; i<8 ; i++)
-		if (bh=sb->s_zmap[i])
-			if ((j=find_first_zero(bh->b_data))<8192)
-				break;
-	if (i>=8 || !bh || j>=8192)
+	size = sb->s_nzones - (sb->s_firstdatazone-1); // 位图中的有效位数，0 位不用
+	if (goal >= sb->s_firstdatazone && goal < sb->s_nzones)
+		j = goal - (sb->s_firstdatazone-1);
+	else
+		j = sb->s_rotor;
+	if (j < 1 || j >= size)
+		j = 1;
+	if ((i = find_next_zero(sb,j,size)) < 0 &&
+	    (i = find_next_zero(sb,1,j)) < 0)
 		return 0;
-	if (set_bit(j,bh->b_data))
+	bh = sb->s_zmap[i>>13];
+	if (set_bit(i&8191,bh->b_data))
 		panic("new_block: bit already set");
 	bh->b_dirt = 1;
-	j += i*8192 + sb->s_firstdatazone-1;
-	if (j >= sb->s_nzones)
-		return 0;
+	sb->s_rotor = i+1;
+	j = i + sb->s_firstdatazone-1;
 	if (!(bh=getblk(dev,j))) // 在缓冲区中，为新的数据块申请一个空闲缓冲块
 		panic("new_block: cannot get block");
 	if (bh->b_count != 1)
@@ -112,7 +147,7 @@ void free_inode(struct m_inode * inode)
 	if (!inode)
 		return;
 	if (!inode->i_dev) {
-		memset(inode,0,sizeof(*inode));
+		memset(inode,0,offsetof(struct m_inode,i_next));
 		return;
 	}
 	if (inode->i_count>1) {
@@ -130,7 +165,8 @@ void free_inode(struct m_inode * inode)
 	if (clear_bit(inode->i_num&8191,bh->b_data)) // 清空 sb.imap 对应位
 		printk("free_inode: bit already cleared.\n\r");
 	bh->b_dirt = 1; // 脏位，需要同步
-	memset(inode,0,sizeof(*inode)); // inode表项清0
+	remove_inode_hash(inode);
+	memset(inode,0,offsetof(struct m_inode,i_next)); // inode 清0，链表指针留着
 }
 
 struct m_inode * new_inode(int dev)
@@ -163,6 +199,7 @@ struct m_inode * new_inode(int dev)
 	inode->i_gid=current->egid;
 	inode->i_dirt=1; // 脏位（目前 inode 还只是在内存中，用完 iput 时需要写回到设备中）
 	inode->i_num = j + i*8192;
+	insert_inode_hash(inode);
 	inode->i_mtime = inode->i_atime = inode->i_ctime = CURRENT_TIME;
 	return inode;
 }
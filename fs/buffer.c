@@ -24,6 +24,7 @@
 #include <linux/sched.h>
 #include <linux/kernel.h>
 #include <asm/system.h>
+#include <asm/spinlock.h>
 #include <asm/io.h>
 
 extern int end; // 内核代码末端地址（在内核模块连接期间设置）
@@ -35,13 +36,17 @@ struct buffer_head * hash_table[NR_HASH];
 static struct buffer_head * free_list;
 static struct task_struct * buffer_wait = NULL;
 int NR_BUFFERS = 0;
+/* protects the hash chains and the free list */
+static spinlock_t buffer_lock = SPIN_LOCK_UNLOCKED;
 
 static inline void wait_on_buffer(struct buffer_head * bh)
 {
-	cli(); // 原子操作
+	unsigned long flags;
+
+	save_flags_cli(flags); // 原子操作
 	while (bh->b_lock) // 重要！！可能考：为什么这里用 while 而不是 if：可能出现很多进程都在等待一个缓冲块。在缓冲块同步完毕，唤醒各等待进程到轮转到某一进程的过程中，很有可能此时的缓冲块又被其它进程所占用，并被加上了锁。此时如果用if()，则此进程会从之前被挂起的地方继续执行，不会再判断是否缓冲块已被占用而直接使用，就会出现错误；而如果用while()，则此进程会再次确认缓冲块是否已被占用，在确认未被占用后，才会使用，这样就不会发生之前那样的错误。【在 make_request 处加的锁】
 		sleep_on(&bh->b_wait); // b_wait 目前等的进程
-	sti();
+	restore_flags(flags);
 }
 
 int sys_sync(void)
@@ -71,6 +76,7 @@ int sync_dev(int dev)
 		wait_on_buffer(bh);
 		if (bh->b_dev == dev && bh->b_dirt)
 			ll_rw_block(WRITE,bh);
+		cond_resched();
 	}
 	sync_inodes();
 	bh = start_buffer;
@@ -80,6 +86,7 @@ int sync_dev(int dev)
 		wait_on_buffer(bh);
 		if (bh->b_dev == dev && bh->b_dirt)
 			ll_rw_block(WRITE,bh);
+		cond_resched();
 	}
 	return 0;
 }
@@ -210,6 +217,7 @@ struct buffer_head * get_hash_table(int dev, int block)
 struct buffer_head * getblk(int dev,int block)
 {
 	struct buffer_head * tmp, * bh;
+	unsigned long flags;
 
 repeat:
 	if (bh = get_hash_table(dev,block)) // 先找现有的：查找哈希表，检索此前是否有程序把现在要读的硬盘逻辑块（相同的设备号和块号）已经读到缓冲区
@@ -241,8 +249,11 @@ repeat:
 	}
 /* NOTE!! While we slept waiting for this block, somebody else might */
 /* already have added "this" block to the cache. check it */
-	if (find_buffer(dev,block)) // 可能有人加载了缓冲块，所以再找一找现成的
+	spin_lock_irqsave(&buffer_lock,flags);
+	if (find_buffer(dev,block) || bh->b_count) { // 可能有人加载了缓冲块，所以再找一找现成的
+		spin_unlock_irqrestore(&buffer_lock,flags);
 		goto repeat;
+	}
 /* OK, FINALLY we know that this buffer is the only one of it's kind, */
 /* and that it's unused (b_count=0), unlocked (b_lock=0), and clean */
 	bh->b_count=1; // 更新 buffer 信息
@@ -252,6 +263,7 @@ repeat:
 	bh->b_dev=dev;
 	bh->b_blocknr=block;
 	insert_into_queues(bh); // insert into hash table
+	spin_unlock_irqrestore(&buffer_lock,flags);
 	return bh;
 }
 
@@ -322,6 +334,48 @@ void bread_page(unsigned long address,int dev,int b[4])
 		}
 }
 
+/*
+ * cached_page() is bread_page() for when we don't want to wait: it only
+ * copies the four blocks in if they are all in the cache and up to date
+ * already, and returns 0 otherwise. Used by fault-around.
+ */
+int cached_page(unsigned long address,int dev,int b[4])
+{
+	struct buffer_head * bh[4];
+	int i;
+
+	for (i=0 ; i<4 ; i++) {
+		bh[i] = NULL;
+		if (!b[i])
+			continue;
+		if (!(bh[i] = find_buffer(dev,b[i])))
+			return 0;
+		if (bh[i]->b_lock || !bh[i]->b_uptodate)
+			return 0;
+	}
+	for (i=0 ; i<4 ; i++,address += BLOCK_SIZE)
+		if (bh[i])
+			COPYBLK((unsigned long) bh[i]->b_data,address);
+	return 1;
+}
+
+/*
+ * Starts reading the blocks of a page that will probably be wanted soon,
+ * without waiting for them (READA: dropped if the queue is full).
+ */
+void breada_page(int dev,int b[4])
+{
+	struct buffer_head * bh;
+	int i;
+
+	for (i=0 ; i<4 ; i++)
+		if (b[i] && (bh = getblk(dev,b[i]))) {
+			if (!bh->b_uptodate)
+				ll_rw_block(READA,bh);
+			bh->b_count--;		/* not brelse(): that waits for it */
+		}
+}
+
 /*
  * Ok, breada can be used as bread, but additionally to mark other
  * blocks for reading as well. End the argument list with a negative
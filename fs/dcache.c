@@ -0,0 +1,166 @@
+/*
+ *  linux/fs/dcache.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * The name cache remembers which inode number a name has in a directory,
+ * so that namei() doesn't read through the directory again for every
+ * path component it has already seen. Entries are keyed by the device
+ * and inode number of the directory, not by its in-core inode, which may
+ * be reused for something else. An inode number of 0 is a negative
+ * entry: the name isn't there.
+ *
+ * There are DCACHE_SIZE entries, on hash chains and on a circular LRU
+ * list; a new name takes the least recently used one. "." and ".." are
+ * never cached (see lookup() in namei.c).
+ *
+ * Anything that changes a directory entry has to call dcache_remove(),
+ * or dcache_invalidate() for a whole directory or device. Both bump
+ * dcache_seq, so that a lookup that slept in find_entry() meanwhile
+ * knows not to add what it found.
+ */
+#include <string.h>
+
+#include <linux/fs.h>
+
+#define DCACHE_SIZE 128
+#define DCACHE_HASH 61
+
+struct dcache_entry {
+	struct dcache_entry * next_hash, * prev_hash;
+	struct dcache_entry * next_lru, * prev_lru;
+	unsigned short dev, dir;	/* dev 0: unused */
+	unsigned short ino;		/* 0: negative entry */
+	unsigned char namelen;
+	char name[NAME_LEN];
+};
+
+static struct dcache_entry dcache[DCACHE_SIZE];
+static struct dcache_entry * hash_table[DCACHE_HASH];
+static struct dcache_entry * lru_head = NULL;	/* least recently used */
+unsigned long dcache_seq = 0;
+
+static int hashfn(int dev, int dir, const char * name, int len)
+{
+	unsigned long h = dev ^ (dir << 4);
+
+	while (len--)
+		h = (h << 3) ^ (h >> 28) ^ (unsigned char) *name++;
+	return h % DCACHE_HASH;
+}
+
+static void init_dcache(void)
+{
+	int i;
+
+	for (i = 0 ; i < DCACHE_SIZE ; i++) {
+		dcache[i].next_lru = dcache + (i+1) % DCACHE_SIZE;
+		dcache[i].prev_lru = dcache + (i+DCACHE_SIZE-1) % DCACHE_SIZE;
+	}
+	lru_head = dcache;
+}
+
+/* make 'de' the most recently used: it goes just before the head */
+static void touch_entry(struct dcache_entry * de)
+{
+	if (de == lru_head) {
+		lru_head = de->next_lru;
+		return;
+	}
+	de->prev_lru->next_lru = de->next_lru;
+	de->next_lru->prev_lru = de->prev_lru;
+	de->next_lru = lru_head;
+	de->prev_lru = lru_head->prev_lru;
+	lru_head->prev_lru->next_lru = de;
+	lru_head->prev_lru = de;
+}
+
+static void unhash_entry(struct dcache_entry * de)
+{
+	if (de->next_hash)
+		de->next_hash->prev_hash = de->prev_hash;
+	if (de->prev_hash)
+		de->prev_hash->next_hash = de->next_hash;
+	else
+		hash_table[hashfn(de->dev,de->dir,de->name,de->namelen)] =
+			de->next_hash;
+	de->dev = 0;
+	touch_entry(de);	/* and then the first to be reused */
+	lru_head = de;
+}
+
+static struct dcache_entry * find_dentry(int dev, int dir,
+	const char * name, int len)
+{
+	struct dcache_entry * de;
+
+	for (de = hash_table[hashfn(dev,dir,name,len)] ; de ; de = de->next_hash)
+		if (de->dev == dev && de->dir == dir && de->namelen == len &&
+		    !memcmp(de->name,name,len))
+			return de;
+	return NULL;
+}
+
+/*
+ * Returns the inode number (0 if the name is known not to be there), or
+ * -1 if the cache doesn't know. 'name' is in kernel space.
+ */
+int dcache_lookup(int dev, int dir, const char * name, int len)
+{
+	struct dcache_entry * de;
+
+	if (!(de = find_dentry(dev,dir,name,len)))
+		return -1;
+	touch_entry(de);
+	return de->ino;
+}
+
+void dcache_add(int dev, int dir, const char * name, int len, int ino)
+{
+	struct dcache_entry * de;
+	int h;
+
+	if (!lru_head)
+		init_dcache();
+	if (!(de = find_dentry(dev,dir,name,len))) {
+		de = lru_head;
+		if (de->dev)
+			unhash_entry(de);
+		de->dev = dev;
+		de->dir = dir;
+		de->namelen = len;
+		memcpy(de->name,name,len);
+		h = hashfn(dev,dir,name,len);
+		de->prev_hash = NULL;
+		if ((de->next_hash = hash_table[h]))
+			de->next_hash->prev_hash = de;
+		hash_table[h] = de;
+	}
+	de->ino = ino;
+	touch_entry(de);
+}
+
+void dcache_remove(int dev, int dir, const char * name, int len)
+{
+	struct dcache_entry * de;
+
+	dcache_seq++;
+	if ((de = find_dentry(dev,dir,name,len)))
+		unhash_entry(de);
+}
+
+/*
+ * Forget everything in directory 'dir' of 'dev', or the whole device
+ * if 'dir' is 0: for rmdir, umount and a changed floppy.
+ */
+void dcache_invalidate(int dev, int dir)
+{
+	int i;
+
+	dcache_seq++;
+	for (i = 0 ; i < DCACHE_SIZE ; i++)
+		if (dcache[i].dev == dev && (!dir || dcache[i].dir == dir))
+			unhash_entry(dcache+i);
+}
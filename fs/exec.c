@@ -158,7 +158,7 @@ static unsigned long change_ldt(unsigned long text_size,unsigned long * page)
 
 	code_limit = text_size+PAGE_SIZE -1;
 	code_limit &= 0xFFFFF000;
-	data_limit = 0x4000000; // 64MB
+	data_limit = TASK_SIZE; // 3GB，每个进程一个页目录，栈在数据段末端
 	code_base = get_base(current->ldt[1]);
 	data_base = code_base;
 	set_base(current->ldt[1],code_base);
@@ -168,11 +168,11 @@ static unsigned long change_ldt(unsigned long text_size,unsigned long * page)
 /* make sure fs points to the NEW data segment */
 	__asm__("pushl $0x17\n\tpop %%fs"::); // fs 设置为LDT数据段
 	// 将参数和环境空间已存放数据的页面（共可有 MAX_ARG_PAGES 页，128kB）放到数据段线性地址的末端。
-	data_base += data_limit;
+	data_base += data_limit;	/* TASK_BASE+TASK_SIZE wraps to 0: fine */
 	for (i=MAX_ARG_PAGES-1 ; i>=0 ; i--) {
 		data_base -= PAGE_SIZE;
 		if (page[i]) // 如果该页面存在
-			put_page(page[i],data_base); // 放在 data_base 线性地址处
+			put_dirty_page(page[i],data_base); // 放在 data_base 线性地址处
 	}
 	return data_limit;
 }
@@ -191,6 +191,7 @@ int do_execve(unsigned long * eip,long tmp,char * filename,
 	int e_uid, e_gid;
 	int retval;
 	int sh_bang = 0;
+	unsigned long new_dir = 0;
 	unsigned long p=PAGE_SIZE*MAX_ARG_PAGES-4; // 参数和环境字符串空间中的偏移指针，初始化为指向该空间的最后一个长字处
 
 	if ((0xffff & eip[1]) != 0x000f) // 如果是内核调用了 do_execve，就会死机 -> 这里的eip是sys_execve压栈的eip，此时为进程2的eip
@@ -299,9 +300,9 @@ restart_interp:
 		goto restart_interp;
 	}
 	brelse(bh); // 数据拷贝后，就释放缓冲区
-	// 对于下列情况，将不执行程序：如果执行文件不是需求页可执行文件(ZMAGIC)、或者代码重定位部分长度 a_trsize 不等于 0、或者数据重定位信息长度不等于 0、或者代码段+数据段+堆段长度超过 50MB、或者 i 节点表明的该执行文件长度小于代码段+数据段+符号表长度+执行头部分长度的总和。
+	// 对于下列情况，将不执行程序：如果执行文件不是需求页可执行文件(ZMAGIC)、或者代码重定位部分长度 a_trsize 不等于 0、或者数据重定位信息长度不等于 0、或者代码段+数据段+堆段长度超过进程空间、或者 i 节点表明的该执行文件长度小于代码段+数据段+符号表长度+执行头部分长度的总和。
 	if (N_MAGIC(ex) != ZMAGIC || ex.a_trsize || ex.a_drsize ||
-		ex.a_text+ex.a_data+ex.a_bss>0x3000000 ||
+		ex.a_text+ex.a_data+ex.a_bss>TASK_SIZE-MAX_ARG_PAGES*PAGE_SIZE ||
 		inode->i_size < ex.a_text+ex.a_data+ex.a_syms+N_TXTOFF(ex)) {
 		retval = -ENOEXEC;
 		goto exec_error2;
@@ -320,11 +321,19 @@ restart_interp:
 			goto exec_error2;
 		}
 	}
+	// vfork 的子进程借用的是父进程的页目录，要换一个自己的
+	if (current->vfork_parent && !(new_dir = new_page_dir())) {
+		retval = -ENOMEM;
+		goto exec_error2;
+	}
 /* OK, This is the point of no return */
 	// 重要！进程2开始解除一些和进程1的共享内容
-	if (current->executable) // 如果有，解除对应的可执行程序
+	if (current->executable) { // 如果有，解除对应的可执行程序
+		del_mapping(current);
 		iput(current->executable);
+	}
 	current->executable = inode; // 设置可执行程序对应的inode
+	add_mapping(current);
 	for (i=0 ; i<32 ; i++) // 清空信号量
 		current->sigaction[i].sa_handler = NULL;
 	for (i=0 ; i<NR_OPEN ; i++) // 关闭 close_on_exec 所标识的打开的文件
@@ -332,8 +341,13 @@ restart_interp:
 			sys_close(i);
 	current->close_on_exec = 0;
 	// 彻底和父进程那里拷贝来的页表脱钩（线性地址空间脱钩） --> 前期要复制是因为，子进程也要运行，运行需要空间，也需要页表分配， 比如执行 execve 前期这段，需要共享父进程的代码，加载并（子进程自己）执行。 --> 脱钩脱的是父进程的用户态
-	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
-	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+	exit_mmap();
+	if (current->vfork_parent)	/* it's the parent's, leave it alone */
+		vfork_release(new_dir);
+	else {
+		free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
+		free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+	}
 	// 如果“上次任务使用了协处理器”指向的是当前进程，则将其置空，并复位使用了协处理器的标志。
 	if (last_task_used_math == current)
 		last_task_used_math = NULL;
@@ -4,6 +4,31 @@
  *  (C) 1991  Linus Torvalds
  */
 
+/*
+ * Open files used to be a fixed file_table[NR_FILE]. They now come from
+ * a slab cache: get_empty_filp() returns one with f_count 1, and the
+ * last close gives it back with put_filp(). There is no limit other
+ * than memory.
+ */
 #include <linux/fs.h>
+#include <linux/mm.h>
+
+static struct kmem_cache filp_cache = KMEM_CACHE("filp",struct file,NULL);
+
+struct file * get_empty_filp(void)
+{
+	struct file * f;
+
+	if (!(f = (struct file *) kmem_cache_alloc(&filp_cache)))
+		return NULL;
+	f->f_mode = f->f_flags = 0;
+	f->f_count = 1;
+	f->f_inode = NULL;
+	f->f_pos = 0;
+	return f;
+}
 
-struct file file_table[NR_FILE]; // NR_FILE=64
+void put_filp(struct file * f)
+{
+	kmem_cache_free(&filp_cache,f);
+}
@@ -5,6 +5,7 @@
  */
 
 #include <string.h>
+#include <stddef.h>
 #include <sys/stat.h>
 
 #include <linux/sched.h>
@@ -12,7 +13,92 @@
 #include <linux/mm.h>
 #include <asm/system.h>
 
-struct m_inode inode_table[NR_INODE]={{0,},}; // NR_INODE = 32, 内存中的 inode
+/*
+ * In-core inodes come from a slab cache and are chained on first_inode.
+ * They are never given back: an unused one still caches its disk inode
+ * for iget(), and once there are max_inodes of them get_empty_inode()
+ * reuses unused ones instead of making more. But when they are all in
+ * use, it just makes another. Since an inode never goes away, a walk of
+ * the list can sleep and carry on (or start over) afterwards.
+ *
+ * iget() finds an inode through a hash on (dev, nr). Unused inodes (with
+ * i_count 0) are also on a circular LRU list, the least recently used
+ * first, and that is the one get_empty_inode() reuses.
+ */
+static struct kmem_cache inode_cache = KMEM_CACHE("inode",struct m_inode,NULL);
+struct m_inode * first_inode = NULL; // 内存中的 inode 链表
+static int nr_inodes = 0;
+static int max_inodes = 0;	/* set from memory size, at least NR_INODE */
+
+#define NR_IHASH 131
+#define _ihashfn(dev,nr) (((unsigned)((dev)^(nr)))%NR_IHASH)
+#define ihash(dev,nr) inode_hash[_ihashfn(dev,nr)]
+
+static struct m_inode * inode_hash[NR_IHASH];
+static struct m_inode * unused_inodes = NULL;	/* LRU: oldest first */
+
+void insert_inode_hash(struct m_inode * inode)
+{
+	inode->i_hash_prev = NULL;
+	if ((inode->i_hash_next = ihash(inode->i_dev,inode->i_num)))
+		inode->i_hash_next->i_hash_prev = inode;
+	ihash(inode->i_dev,inode->i_num) = inode;
+}
+
+/* must be called before i_dev or i_num change */
+void remove_inode_hash(struct m_inode * inode)
+{
+	if (inode->i_hash_prev)
+		inode->i_hash_prev->i_hash_next = inode->i_hash_next;
+	else if (ihash(inode->i_dev,inode->i_num) == inode)
+		ihash(inode->i_dev,inode->i_num) = inode->i_hash_next;
+	else
+		return;		/* not hashed */
+	if (inode->i_hash_next)
+		inode->i_hash_next->i_hash_prev = inode->i_hash_prev;
+	inode->i_hash_next = inode->i_hash_prev = NULL;
+}
+
+static struct m_inode * find_inode(int dev, int nr)
+{
+	struct m_inode * inode;
+
+	for (inode = ihash(dev,nr) ; inode ; inode = inode->i_hash_next)
+		if (inode->i_dev == dev && inode->i_num == nr)
+			return inode;
+	return NULL;
+}
+
+/* i_count has just gone to 0 */
+static void put_last_unused(struct m_inode * inode)
+{
+	if (inode->i_lru_next)
+		return;
+	if (!unused_inodes) {
+		inode->i_lru_next = inode->i_lru_prev = inode;
+		unused_inodes = inode;
+		return;
+	}
+	inode->i_lru_next = unused_inodes;
+	inode->i_lru_prev = unused_inodes->i_lru_prev;
+	unused_inodes->i_lru_prev->i_lru_next = inode;
+	unused_inodes->i_lru_prev = inode;
+}
+
+static void remove_unused(struct m_inode * inode)
+{
+	if (!inode->i_lru_next)
+		return;
+	if (inode->i_lru_next == inode)
+		unused_inodes = NULL;
+	else {
+		inode->i_lru_prev->i_lru_next = inode->i_lru_next;
+		inode->i_lru_next->i_lru_prev = inode->i_lru_prev;
+		if (unused_inodes == inode)
+			unused_inodes = inode->i_lru_next;
+	}
+	inode->i_lru_next = inode->i_lru_prev = NULL;
+}
 
 static void read_inode(struct m_inode * inode);
 static void write_inode(struct m_inode * inode);
@@ -42,15 +128,17 @@ static inline void unlock_inode(struct m_inode * inode)
 
 void invalidate_inodes(int dev)
 {
-	int i;
 	struct m_inode * inode;
 
-	inode = 0+inode_table;
-	for(i=0 ; i<NR_INODE ; i++,inode++) {
+	dcache_invalidate(dev,0);
+	for (inode = first_inode ; inode ; inode = inode->i_next) {
 		wait_on_inode(inode);
 		if (inode->i_dev == dev) {
 			if (inode->i_count)
 				printk("inode in use on removed disk\n\r");
+			if (inode->i_index)
+				free_dir_index(inode);
+			remove_inode_hash(inode);
 			inode->i_dev = inode->i_dirt = 0;
 		}
 	}
@@ -58,21 +146,25 @@ void invalidate_inodes(int dev)
 
 void sync_inodes(void)
 {
-	int i;
 	struct m_inode * inode;
 
-	inode = 0+inode_table;
-	for(i=0 ; i<NR_INODE ; i++,inode++) {
+	for (inode = first_inode ; inode ; inode = inode->i_next) {
 		wait_on_inode(inode);
-		if (inode->i_dirt && !inode->i_pipe) // inode_table[32] --> 缓冲区
+		if (inode->i_dirt && !inode->i_pipe) // 内存 inode --> 缓冲区
 			write_inode(inode);
 	}
 }
 
+/*
+ * The goal for a new block: right after the one before it in the file,
+ * or the indirect block it's listed in (see new_block()).
+ */
+#define goal_after(nr) ((nr) ? (nr)+1 : 0)
+
 static int _bmap(struct m_inode * inode,int block,int create)
 {
 	struct buffer_head * bh;
-	int i;
+	int i,j;
 
 	if (block<0)
 		panic("_bmap: block<0");
@@ -80,7 +172,8 @@ static int _bmap(struct m_inode * inode,int block,int create)
 		panic("_bmap: block>big");
 	if (block<7) {
 		if (create && !inode->i_zone[block])
-			if (inode->i_zone[block]=new_block(inode->i_dev)) { // 在设备上创建一个新数据块
+			if (inode->i_zone[block]=new_block(inode->i_dev,
+			    block ? goal_after(inode->i_zone[block-1]) : 0)) { // 在设备上创建一个新数据块
 				inode->i_ctime=CURRENT_TIME;
 				inode->i_dirt=1;
 			}
@@ -89,7 +182,8 @@ static int _bmap(struct m_inode * inode,int block,int create)
 	block -= 7;
 	if (block<512) {
 		if (create && !inode->i_zone[7])
-			if (inode->i_zone[7]=new_block(inode->i_dev)) { // 一级
+			if (inode->i_zone[7]=new_block(inode->i_dev,
+			    goal_after(inode->i_zone[6]))) { // 一级
 				inode->i_dirt=1;
 				inode->i_ctime=CURRENT_TIME;
 			}
@@ -99,7 +193,9 @@ static int _bmap(struct m_inode * inode,int block,int create)
 			return 0;
 		i = ((unsigned short *) (bh->b_data))[block];
 		if (create && !i)
-			if (i=new_block(inode->i_dev)) { // 需要的逻辑块
+			if (i=new_block(inode->i_dev,goal_after(block ?
+			    ((unsigned short *) (bh->b_data))[block-1] :
+			    inode->i_zone[7]))) { // 需要的逻辑块
 				((unsigned short *) (bh->b_data))[block]=i;
 				bh->b_dirt=1;
 			}
@@ -108,7 +204,8 @@ static int _bmap(struct m_inode * inode,int block,int create)
 	}
 	block -= 512;
 	if (create && !inode->i_zone[8])
-		if (inode->i_zone[8]=new_block(inode->i_dev)) { // 一级
+		if (inode->i_zone[8]=new_block(inode->i_dev,
+		    goal_after(inode->i_zone[7]))) { // 一级
 			inode->i_dirt=1;
 			inode->i_ctime=CURRENT_TIME;
 		}
@@ -118,7 +215,9 @@ static int _bmap(struct m_inode * inode,int block,int create)
 		return 0;
 	i = ((unsigned short *)bh->b_data)[block>>9];
 	if (create && !i)
-		if (i=new_block(inode->i_dev)) { // 二级
+		if (i=new_block(inode->i_dev,goal_after((block>>9) ?
+		    ((unsigned short *) (bh->b_data))[(block>>9)-1] :
+		    inode->i_zone[8]))) { // 二级
 			((unsigned short *) (bh->b_data))[block>>9]=i;
 			bh->b_dirt=1;
 		}
@@ -127,9 +226,11 @@ static int _bmap(struct m_inode * inode,int block,int create)
 		return 0;
 	if (!(bh=bread(inode->i_dev,i)))
 		return 0;
+	j = i;
 	i = ((unsigned short *)bh->b_data)[block&511];
 	if (create && !i)
-		if (i=new_block(inode->i_dev)) { // 需要的逻辑块
+		if (i=new_block(inode->i_dev,goal_after((block&511) ?
+		    ((unsigned short *) (bh->b_data))[(block&511)-1] : j))) { // 需要的逻辑块
 			((unsigned short *) (bh->b_data))[block&511]=i;
 			bh->b_dirt=1;
 		}
@@ -164,10 +265,12 @@ void iput(struct m_inode * inode)
 		inode->i_count=0;
 		inode->i_dirt=0;
 		inode->i_pipe=0;
+		put_last_unused(inode);
 		return;
 	}
 	if (!inode->i_dev) { // 如果 inode 所在外设设备号为 0 --> 即无设备
-		inode->i_count--;
+		if (!--inode->i_count)
+			put_last_unused(inode);
 		return;
 	}
 	if (S_ISBLK(inode->i_mode)) { // 如果是块设备
@@ -181,7 +284,8 @@ repeat:
 	}
 	if (!inode->i_nlinks) { // i节点链接数为0 --> 类似于 windows 下的快捷方式/软链接
 		truncate(inode); // 释放 inode 对应的所有逻辑块
-		free_inode(inode); // 释放 inode
+		free_inode(inode); // 释放 inode，i_count 也清 0 了
+		put_last_unused(inode);
 		return;
 	}
 	if (inode->i_dirt) { // 如果 inode 内容已经改变，同步该 inode 内容到外设
@@ -190,39 +294,63 @@ repeat:
 		goto repeat;
 	}
 	inode->i_count--;
+	put_last_unused(inode); // 放到未用 LRU 的尾部，仍可被 iget 找到
 	return;
 }
 
+static struct m_inode * grow_inodes(void)
+{
+	struct m_inode * inode;
+
+	if (!(inode = (struct m_inode *) kmem_cache_alloc(&inode_cache)))
+		return NULL;
+	memset(inode,0,sizeof(*inode));
+	inode->i_next = first_inode;
+	first_inode = inode;
+	nr_inodes++;
+	return inode;
+}
+
+/*
+ * One in-core inode for every 16 pages (64kB) of memory: about as many
+ * as there are likely to be files in use and worth keeping around.
+ */
+static void set_max_inodes(void)
+{
+	max_inodes = paging_pages/16;
+	if (max_inodes < NR_INODE)
+		max_inodes = NR_INODE;
+}
+
 struct m_inode * get_empty_inode(void)
 {
 	struct m_inode * inode;
-	static struct m_inode * last_inode = inode_table;
-	int i;
-
-	do {
-		inode = NULL;
-		for (i = NR_INODE; i ; i--) {
-			if (++last_inode >= inode_table + NR_INODE)
-				last_inode = inode_table;
-			if (!last_inode->i_count) {
-				inode = last_inode;
-				if (!inode->i_dirt && !inode->i_lock)
-					break;
-			}
-		}
-		if (!inode) {
-			for (i=0 ; i<NR_INODE ; i++)
-				printk("%04x: %6d\t",inode_table[i].i_dev,
-					inode_table[i].i_num);
-			panic("No free inodes in mem");
+
+	if (!max_inodes)
+		set_max_inodes();
+repeat:
+	inode = NULL;
+	if (nr_inodes < max_inodes || !unused_inodes)
+		inode = grow_inodes();
+	if (!inode) {
+		if (!(inode = unused_inodes)) {
+			printk("No free inodes in mem\n\r");
+			return NULL;
 		}
+		remove_unused(inode);
 		wait_on_inode(inode);
 		while (inode->i_dirt) {
 			write_inode(inode);
 			wait_on_inode(inode);
 		}
-	} while (inode->i_count);
-	memset(inode,0,sizeof(*inode));
+		/* somebody took it, or took and dropped it, while we slept */
+		if (inode->i_count || inode->i_lru_next)
+			goto repeat;
+		remove_inode_hash(inode);
+		if (inode->i_index)
+			free_dir_index(inode);
+	}
+	memset(inode,0,offsetof(struct m_inode,i_next));
 	inode->i_count = 1;
 	return inode;
 }
@@ -234,7 +362,7 @@ struct m_inode * get_pipe_inode(void)
 	if (!(inode = get_empty_inode()))
 		return NULL;
 	if (!(inode->i_size=get_free_page())) {
-		inode->i_count = 0;
+		iput(inode);
 		return NULL;
 	}
 	inode->i_count = 2;	/* sum of readers/writers */
@@ -243,26 +371,24 @@ struct m_inode * get_pipe_inode(void)
 	return inode;
 }
 
-/* 根据设备号和i节点号，从设备上读取指定节点号的 i 节点 */
+/*
+ * 根据设备号和i节点号，从设备上读取指定节点号的 i 节点。An empty inode
+ * is only got if it isn't in memory already; as that may sleep, we look
+ * again afterwards.
+ */
 struct m_inode * iget(int dev,int nr)
 {
-	struct m_inode * inode, * empty;
+	struct m_inode * inode, * empty = NULL;
 
 	if (!dev)
 		panic("iget with dev==0");
-	empty = get_empty_inode(); // 先找一个空的占位，再去看有没有现成的
-	inode = inode_table;
-	while (inode < NR_INODE+inode_table) { // 看看有没有现成的
-		if (inode->i_dev != dev || inode->i_num != nr) {
-			inode++;
-			continue;
-		}
+repeat:
+	if ((inode = find_inode(dev,nr))) { // 看看有没有现成的
 		wait_on_inode(inode);
-		if (inode->i_dev != dev || inode->i_num != nr) { // 若等待期间发生变化，则继续搜索。比如多个进程等待，但其他进程先抢占了
-			inode = inode_table;
-			continue;
-		}
-		inode->i_count++;
+		if (inode->i_dev != dev || inode->i_num != nr) // 若等待期间发生变化，则重新查找。比如多个进程等待，但其他进程先抢占了
+			goto repeat;
+		if (!inode->i_count++)
+			remove_unused(inode);
 		if (inode->i_mount) { // 如果该 i 节点是其它文件系统的安装点，则在超级块表中搜寻安装在此 i 节点的超级块。如果没有找到超级块，则直接使用该节点
 			int i;
 
@@ -279,18 +405,21 @@ struct m_inode * iget(int dev,int nr)
 			iput(inode);
 			dev = super_block[i].s_dev; // 安装的文件系统，dev可能会变化，所以这里要改变。
 			nr = ROOT_INO; // 安装的文件系统的inode，为根inode
-			inode = inode_table; // dev+nr变化，需要再次遍历确认是否加载
-			continue;
+			goto repeat; // dev+nr变化，需要再次查找确认是否加载
 		}
 		if (empty)
 			iput(empty);
 		return inode;
 	}
-	if (!empty)
-		return (NULL);
+	if (!empty) { // 不在内存中，才要一个空的
+		if (!(empty = get_empty_inode()))
+			return (NULL);
+		goto repeat;
+	}
 	inode=empty;
 	inode->i_dev = dev;
 	inode->i_num = nr;
+	insert_inode_hash(inode);
 	read_inode(inode); // 并从相应设备上读取该 i 节点信息。返回该 i 节点
 	return inode;
 }
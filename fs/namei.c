@@ -77,6 +77,188 @@ static int match(int len,const char * name,struct dir_entry * de)
 	return same;
 }
 
+/*
+ * Large directories get an index in memory (it can't be on the disk, as
+ * that has to stay minix): the disk block of each directory block, and
+ * an open-addressed hash table from names to entry numbers. The table
+ * only gives hints - whatever it points at is checked with match() - so
+ * a removed name needn't be taken out: it's skipped, and the table is
+ * thrown away and built again once it gets too full. first_free is at
+ * or below the first free entry, which is where add_entry() starts.
+ *
+ * A directory gets its index when it's searched with DINDEX_MIN or more
+ * entries, and loses it when its in-core inode is reused. Every change
+ * to a directory bumps dcache_seq (see forget_entry()), which is how a
+ * search that slept knows the index may not be the same any more.
+ */
+#define DINDEX_MIN (4*DIR_ENTRIES_PER_BLOCK)
+#define DINDEX_MAX_ORDER 4
+
+struct dir_index {
+	int order;			/* size of this, for free_pages() */
+	int nr_blocks, max_blocks;
+	int size, used;			/* table slots, a power of 2 */
+	int first_free;
+	unsigned short * blocks;	/* disk block of each dir block */
+	unsigned short * table;		/* entry number+1, 0 is empty */
+};
+
+static int name_hash(const char * name, int len)
+{
+	unsigned long h = 0;
+
+	while (len-- && *name)
+		h = (h << 5) + h + (unsigned char) *name++;
+	return h;
+}
+
+static void index_insert(struct dir_index * idx, const char * name, int nr)
+{
+	int h;
+
+	for (h = name_hash(name,NAME_LEN) ; idx->table[h &= idx->size-1] ; h++)
+		/* nothing */ ;
+	idx->table[h] = nr+1;
+	idx->used++;
+}
+
+void free_dir_index(struct m_inode * dir)
+{
+	struct dir_index * idx = dir->i_index;
+
+	dir->i_index = NULL;
+	free_pages((unsigned long) idx,idx->order);
+}
+
+/*
+ * Reads the whole directory. Returns NULL if it's too big or can't be
+ * read, or if it changed while we read it.
+ */
+static struct dir_index * build_dir_index(struct m_inode * dir)
+{
+	struct dir_index * idx;
+	struct buffer_head * bh;
+	struct dir_entry * de;
+	unsigned long seq = dcache_seq;
+	int entries, nr_blocks, max_blocks, size, order, b, i;
+
+	entries = dir->i_size / (sizeof (struct dir_entry));
+	nr_blocks = (entries + DIR_ENTRIES_PER_BLOCK-1) / DIR_ENTRIES_PER_BLOCK;
+	max_blocks = nr_blocks + nr_blocks/2 + 1;	/* room to grow */
+	for (size = 64 ; size < 2*max_blocks*DIR_ENTRIES_PER_BLOCK ; size <<= 1)
+		/* nothing */ ;
+	b = sizeof (struct dir_index) + 2*(max_blocks+size);
+	for (order = 0 ; (PAGE_SIZE << order) < b ; order++)
+		/* nothing */ ;
+	if (order > DINDEX_MAX_ORDER)
+		return NULL;
+	if (!(idx = (struct dir_index *) get_free_pages(order)))
+		return NULL;
+	idx->order = order;
+	idx->nr_blocks = nr_blocks;
+	idx->max_blocks = max_blocks;
+	idx->size = size;
+	idx->first_free = entries;
+	idx->blocks = (unsigned short *) (idx+1);
+	idx->table = idx->blocks + max_blocks;
+	for (b = 0 ; b < nr_blocks ; b++) {
+		if (!(idx->blocks[b] = bmap(dir,b)))
+			continue;	/* a hole: nothing there */
+		if (!(bh = bread(dir->i_dev,idx->blocks[b])))
+			break;
+		de = (struct dir_entry *) bh->b_data;
+		for (i = b*DIR_ENTRIES_PER_BLOCK ; i < entries &&
+		     i < (b+1)*DIR_ENTRIES_PER_BLOCK ; i++, de++)
+			if (de->inode)
+				index_insert(idx,de->name,i);
+			else if (i < idx->first_free)
+				idx->first_free = i;
+		brelse(bh);
+	}
+	if (b < nr_blocks || seq != dcache_seq || dir->i_index) {
+		free_pages((unsigned long) idx,order);
+		return NULL;
+	}
+	return idx;
+}
+
+/*
+ * Returns 1 and the entry if found, 0 if not, and -1 if the directory
+ * changed while we slept, so that find_entry() has to do it the slow
+ * way after all.
+ */
+static int index_find(struct m_inode * dir, const char * name, int namelen,
+	struct buffer_head ** res_bh, struct dir_entry ** res_dir)
+{
+	struct dir_index * idx = dir->i_index;
+	unsigned long seq = dcache_seq;
+	struct buffer_head * bh;
+	struct dir_entry * de;
+	char buf[NAME_LEN];
+	int h, nr;
+
+	for (h = 0 ; h < NAME_LEN ; h++)
+		buf[h] = (h < namelen) ? get_fs_byte(name+h) : 0;
+	for (h = name_hash(buf,NAME_LEN) ; (nr = idx->table[h &= idx->size-1]) ; h++) {
+		nr--;
+		if (nr*sizeof (struct dir_entry) >= dir->i_size)
+			continue;
+		bh = bread(dir->i_dev,idx->blocks[nr/DIR_ENTRIES_PER_BLOCK]);
+		if (seq != dcache_seq) {
+			brelse(bh);
+			return -1;
+		}
+		if (!bh)
+			continue;
+		de = nr%DIR_ENTRIES_PER_BLOCK + (struct dir_entry *) bh->b_data;
+		if (match(namelen,name,de)) {
+			*res_bh = bh;
+			*res_dir = de;
+			return 1;
+		}
+		brelse(bh);
+	}
+	return 0;
+}
+
+/* add_entry() has put a name in entry 'nr', which is in 'block' */
+static void index_add_entry(struct m_inode * dir, struct dir_entry * de,
+	int nr, int block)
+{
+	struct dir_index * idx;
+	int b = nr/DIR_ENTRIES_PER_BLOCK;
+
+	if (!(idx = dir->i_index))
+		return;
+	if (b >= idx->max_blocks || 4*idx->used >= 3*idx->size) {
+		free_dir_index(dir);	/* build a bigger one next time */
+		return;
+	}
+	idx->blocks[b] = block;
+	if (b >= idx->nr_blocks)
+		idx->nr_blocks = b+1;
+	index_insert(idx,de->name,nr);
+	idx->first_free = nr+1;
+}
+
+/* the name in 'de' has been removed */
+static void index_free_entry(struct m_inode * dir, struct buffer_head * bh,
+	struct dir_entry * de)
+{
+	struct dir_index * idx;
+	int b, nr;
+
+	if (!(idx = dir->i_index))
+		return;
+	for (b = 0 ; b < idx->nr_blocks ; b++)
+		if (idx->blocks[b] == bh->b_blocknr) {
+			nr = b*DIR_ENTRIES_PER_BLOCK + (de - (struct dir_entry *) bh->b_data);
+			if (nr < idx->first_free)
+				idx->first_free = nr;
+			return;
+		}
+}
+
 /*
  *	find_entry()
  *
@@ -98,6 +280,7 @@ static struct buffer_head * find_entry(struct m_inode ** dir,
 	struct buffer_head * bh;
 	struct dir_entry * de;
 	struct super_block * sb;
+	struct dir_index * idx;
 
 #ifdef NO_TRUNCATE // 如果定义了 NO_TRUNCATE，则若文件名长度超过最大长度 NAME_LEN，则返回
 	if (namelen > NAME_LEN)
@@ -127,6 +310,14 @@ static struct buffer_head * find_entry(struct m_inode ** dir,
 			}
 		}
 	}
+	if (!(*dir)->i_index && (*dir)->i_size >= DINDEX_MIN*sizeof (struct dir_entry)
+	    && (idx = build_dir_index(*dir)))
+		(*dir)->i_index = idx;
+	if ((*dir)->i_index) // 大目录走索引
+		switch (index_find(*dir,name,namelen,&bh,res_dir)) {
+			case 1: return bh;
+			case 0: return NULL;
+		}
 	if (!(block = (*dir)->i_zone[0]))
 		return NULL;
 	if (!(bh = bread((*dir)->i_dev,block))) // 设备号、块号
@@ -155,6 +346,60 @@ static struct buffer_head * find_entry(struct m_inode ** dir,
 	return NULL;
 }
 
+/*
+ * The name cache (dcache.c) has to forget a name whenever its directory
+ * entry changes. 'de' is in the buffer, so in kernel space.
+ */
+static void forget_entry(struct m_inode * dir, struct dir_entry * de)
+{
+	int len;
+
+	for (len = 0 ; len < NAME_LEN && de->name[len] ; len++)
+		/* nothing */ ;
+	dcache_remove(dir->i_dev,dir->i_num,de->name,len);
+}
+
+/*
+ *	lookup()
+ *
+ * returns the inode number of 'name' in '*dir', or 0 if it isn't there.
+ * It goes through the name cache, and only reads the directory (with
+ * find_entry(), which may exchange '*dir' for '..') if that doesn't know.
+ */
+static int lookup(struct m_inode ** dir, const char * name, int namelen)
+{
+	char buf[NAME_LEN];
+	struct buffer_head * bh;
+	struct dir_entry * de;
+	unsigned long seq;
+	int i, inr, cache;
+
+#ifdef NO_TRUNCATE
+	if (namelen > NAME_LEN)
+		return 0;
+#else
+	if (namelen > NAME_LEN)
+		namelen = NAME_LEN;
+#endif
+	for (i = 0 ; i < namelen ; i++)
+		buf[i] = get_fs_byte(name+i);
+	// "." 和 ".." 不进缓存：find_entry 对 ".." 有特殊处理
+	cache = namelen && !(buf[0] == '.' &&
+		(namelen == 1 || (namelen == 2 && buf[1] == '.')));
+	if (cache && (inr = dcache_lookup((*dir)->i_dev,(*dir)->i_num,
+	    buf,namelen)) >= 0)
+		return inr;
+	seq = dcache_seq;
+	if ((bh = find_entry(dir,name,namelen,&de))) {
+		inr = de->inode;
+		brelse(bh);
+	} else
+		inr = 0;
+	if (cache && seq == dcache_seq) // 读目录时睡眠过，目录项可能已经变了
+		dcache_add((*dir)->i_dev,(*dir)->i_num,buf,namelen,inr);
+	return inr;
+}
+
 /*
  *	add_entry()
  *
@@ -168,7 +413,7 @@ static struct buffer_head * find_entry(struct m_inode ** dir,
 static struct buffer_head * add_entry(struct m_inode * dir,
 	const char * name, int namelen, struct dir_entry ** res_dir)
 {
-	int block,i;
+	int block,i,nr;
 	struct buffer_head * bh;
 	struct dir_entry * de;
 
@@ -182,12 +427,12 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 #endif
 	if (!namelen)
 		return NULL;
-	if (!(block = dir->i_zone[0])) // 如果目录 i 节点指向的第一个直接磁盘块号为0
+	i = dir->i_index ? dir->i_index->first_free : 0; // 有索引就从第一个空项开始找
+	if (!(block = i ? create_block(dir,i/DIR_ENTRIES_PER_BLOCK) : dir->i_zone[0])) // 如果目录 i 节点指向的第一个直接磁盘块号为0
 		return NULL;
 	if (!(bh = bread(dir->i_dev,block)))
 		return NULL;
-	i = 0;
-	de = (struct dir_entry *) bh->b_data;
+	de = i%DIR_ENTRIES_PER_BLOCK + (struct dir_entry *) bh->b_data;
 	while (1) {
 		if ((char *)de >= BLOCK_SIZE+bh->b_data) {
 			brelse(bh); // 释放该数据块
@@ -209,8 +454,11 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 		}
 		if (!de->inode) { // 若该目录项的 i 节点为空，则表示找到一个还未使用的目录项。
 			dir->i_mtime = CURRENT_TIME;
+			nr = i;
 			for (i=0; i < NAME_LEN ; i++)
 				de->name[i]=(i<namelen)?get_fs_byte(name+i):0;
+			forget_entry(dir,de); // 名字缓存里可能有它的否定项
+			index_add_entry(dir,de,nr,block);
 			bh->b_dirt = 1;
 			*res_dir = de;
 			return bh;
@@ -233,9 +481,7 @@ static struct m_inode * get_dir(const char * pathname)
 	char c;
 	const char * thisname;
 	struct m_inode * inode;
-	struct buffer_head * bh;
 	int namelen,inr,idev;
-	struct dir_entry * de;
 
 	if (!current->root || !current->root->i_count) // 确认根i节点是否正确 --> 绝对路径
 		panic("No root inode");
@@ -260,13 +506,11 @@ static struct m_inode * get_dir(const char * pathname)
 			/* nothing */ ;
 		if (!c) // c 如果为空，说明读到底了（即thisname[0...namelen-1]为目标文件名字）
 			return inode; // 【正常情况下，在这儿结束】
-		if (!(bh = find_entry(&inode,thisname,namelen,&de))) { // thisname[0...namelen-1] 就是需要的目录；de 放置了目录文件的 inr
-			iput(inode); // 缓冲块为空，释放 inode
+		if (!(inr = lookup(&inode,thisname,namelen))) { // thisname[0...namelen-1] 就是需要的目录，inr 是它的 i 节点号
+			iput(inode); // 没有这一项，释放 inode
 			return NULL;
 		}
-		inr = de->inode;
 		idev = inode->i_dev;
-		brelse(bh);
 		iput(inode);
 		if (!(inode = iget(idev,inr))) // 根据设备名和inr获取inode值
 			return NULL;
@@ -311,21 +555,16 @@ struct m_inode * namei(const char * pathname)
 	const char * basename;
 	int inr,dev,namelen;
 	struct m_inode * dir;
-	struct buffer_head * bh;
-	struct dir_entry * de;
 
 	if (!(dir = dir_namei(pathname,&namelen,&basename)))
 		return NULL;
 	if (!namelen)			/* special case: '/usr/' etc */
 		return dir;
-	bh = find_entry(&dir,basename,namelen,&de);
-	if (!bh) {
+	if (!(inr = lookup(&dir,basename,namelen))) {
 		iput(dir);
 		return NULL;
 	}
-	inr = de->inode;
 	dev = dir->i_dev;
-	brelse(bh);
 	iput(dir);
 	dir=iget(dev,inr);
 	if (dir) {
@@ -365,8 +604,8 @@ int open_namei(const char * pathname, int flag, int mode,
 		iput(dir);
 		return -EISDIR;
 	}
-	bh = find_entry(&dir,basename,namelen,&de); // 枝梢目录文件，放在缓冲区中
-	if (!bh) { // 没有文件就新建文件
+	inr = lookup(&dir,basename,namelen); // 在枝梢目录中找目标文件的 i 节点号
+	if (!inr) { // 没有文件就新建文件
 		if (!(flag & O_CREAT)) { // 如果没有置位，即不新建文件，但又没有文件，返回错误
 			iput(dir);
 			return -ENOENT;
@@ -397,9 +636,7 @@ int open_namei(const char * pathname, int flag, int mode,
 		*res_inode = inode;
 		return 0;
 	}
-	inr = de->inode; // i number
 	dev = dir->i_dev; // 设备号
-	brelse(bh); // 找到了就释放 缓冲块和inode_table
 	iput(dir);
 	if (flag & O_EXCL)
 		return -EEXIST;
@@ -502,7 +739,7 @@ int sys_mkdir(const char * pathname, int mode)
 	inode->i_size = 32;
 	inode->i_dirt = 1;
 	inode->i_mtime = inode->i_atime = CURRENT_TIME;
-	if (!(inode->i_zone[0]=new_block(inode->i_dev))) {
+	if (!(inode->i_zone[0]=new_block(inode->i_dev,0))) {
 		iput(dir);
 		inode->i_nlinks--;
 		iput(inode);
@@ -656,6 +893,9 @@ int sys_rmdir(const char * name)
 	if (inode->i_nlinks != 2)
 		printk("empty directory has nlink!=2 (%d)",inode->i_nlinks);
 	de->inode = 0;
+	forget_entry(dir,de);
+	index_free_entry(dir,bh,de);
+	dcache_invalidate(inode->i_dev,inode->i_num); // 它自己的否定项
 	bh->b_dirt = 1;
 	brelse(bh);
 	inode->i_nlinks=0;
@@ -717,6 +957,8 @@ int sys_unlink(const char * name)
 	}
 	// 文件删除工作
 	de->inode = 0; // 目录项清除
+	forget_entry(dir,de);
+	index_free_entry(dir,bh,de);
 	bh->b_dirt = 1; // 目录项所在缓冲区脏位
 	brelse(bh);
 	inode->i_nlinks--; // 减少链接数
@@ -148,15 +148,12 @@ int sys_open(const char * filename,int flag,int mode)
 	if (fd>=NR_OPEN)
 		return -EINVAL;
 	current->close_on_exec &= ~(1<<fd);
-	f=0+file_table;
-	for (i=0 ; i<NR_FILE ; i++,f++) // file_table 中找空闲项
-		if (!f->f_count) break; // f_count 为0
-	if (i>=NR_FILE)
-		return -EINVAL;
-	(current->filp[fd]=f)->f_count++; // 两个操作完成flip和file_table挂载：filp 文件对应，f_count 基于 file 进行计数
+	if (!(f=get_empty_filp())) // 从 filp 缓存中取一个，f_count 已经是 1
+		return -ENFILE;
+	current->filp[fd]=f; // filp 和 file 挂载，f_count 基于 file 进行计数
 	if ((i=open_namei(filename,flag,mode,&inode))<0) { // 打开文件获取 i 节点
 		current->filp[fd]=NULL;
-		f->f_count=0;
+		put_filp(f);
 		return i;
 	}
 /* ttys are somewhat special (ttyxx major==4, tty major==5) */
@@ -170,7 +167,7 @@ int sys_open(const char * filename,int flag,int mode)
 			if (current->tty<0) {
 				iput(inode);
 				current->filp[fd]=NULL;
-				f->f_count=0;
+				put_filp(f);
 				return -EPERM;
 			}
 /* Likewise with block-devices: check for floppy_change */
@@ -180,8 +177,7 @@ int sys_open(const char * filename,int flag,int mode)
 	// 初始化文件结构。置文件结构属性和标志，
 	f->f_mode = inode->i_mode; // 文件属性
 	f->f_flags = flag; // 文件标识
-	f->f_count = 1;
-	f->f_inode = inode; // file_table 上 inode 挂载，【文件与i节点建立关系】
+	f->f_inode = inode; // file 上 inode 挂载，【文件与i节点建立关系】
 	f->f_pos = 0; // 文件读写指针位置
 	return (fd);
 }
@@ -200,11 +196,12 @@ int sys_close(unsigned int fd)
 	current->close_on_exec &= ~(1<<fd);
 	if (!(filp = current->filp[fd]))
 		return -EINVAL;
-	current->filp[fd] = NULL; // filp 和 file_table 解除关系
+	current->filp[fd] = NULL; // filp 和 file 解除关系
 	if (filp->f_count == 0)
 		panic("Close: file count is 0");
 	if (--filp->f_count)
 		return (0);
 	iput(filp->f_inode); // 如果文件已经没有引用了，inode 释放到设备中
+	put_filp(filp);
 	return (0);
 }
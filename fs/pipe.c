@@ -75,14 +75,12 @@ int sys_pipe(unsigned long * fildes)
 	int fd[2];
 	int i,j;
 
-	j=0;
-	for(i=0;j<2 && i<NR_FILE;i++)
-		if (!file_table[i].f_count)
-			(f[j++]=i+file_table)->f_count++;
-	if (j==1)
-		f[0]->f_count=0;
-	if (j<2)
+	if (!(f[0]=get_empty_filp()))
 		return -1;
+	if (!(f[1]=get_empty_filp())) {
+		put_filp(f[0]);
+		return -1;
+	}
 	j=0;
 	for(i=0;j<2 && i<NR_OPEN;i++)
 		if (!current->filp[i]) {
@@ -92,13 +90,15 @@ int sys_pipe(unsigned long * fildes)
 	if (j==1)
 		current->filp[fd[0]]=NULL;
 	if (j<2) {
-		f[0]->f_count=f[1]->f_count=0;
+		put_filp(f[0]);
+		put_filp(f[1]);
 		return -1;
 	}
 	if (!(inode=get_pipe_inode())) {
 		current->filp[fd[0]] =
 			current->filp[fd[1]] = NULL;
-		f[0]->f_count = f[1]->f_count = 0;
+		put_filp(f[0]);
+		put_filp(f[1]);
 		return -1;
 	}
 	f[0]->f_inode = f[1]->f_inode = inode;
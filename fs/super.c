@@ -121,6 +121,7 @@ static struct super_block * read_super(int dev)
 	s->s_time = 0;
 	s->s_rd_only = 0;
 	s->s_dirt = 0;
+	s->s_rotor = 0;
 	lock_super(s); // 加锁，之后会涉及读缓冲块
 	if (!(bh = bread(dev,1))) { // bread 读超级块到缓冲区，超级块在该设备的第2项（索引1，细节）
 		s->s_dev=0;
@@ -187,9 +188,10 @@ int sys_umount(char * dev_name)
 		return -ENOENT;
 	if (!sb->s_imount->i_mount)
 		printk("Mounted inode has i_mount=0\n");
-	for (inode=inode_table+0 ; inode<inode_table+NR_INODE ; inode++)
+	for (inode=first_inode ; inode ; inode=inode->i_next)
 		if (inode->i_dev==dev && inode->i_count)
 				return -EBUSY;
+	dcache_invalidate(dev,0);
 	sb->s_imount->i_mount=0;
 	iput(sb->s_imount);
 	sb->s_imount = NULL;
@@ -252,8 +254,6 @@ void mount_root(void)
 
 	if (32 != sizeof (struct d_inode))
 		panic("bad i-node size");
-	for(i=0;i<NR_FILE;i++) // 初始化文件引用计数
-		file_table[i].f_count=0;
 	if (MAJOR(ROOT_DEV) == 2) { // 根设备现在是虚拟盘
 		printk("Insert root floppy and press ENTER");
 		wait_for_keypress();
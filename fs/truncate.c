@@ -51,6 +51,8 @@ void truncate(struct m_inode * inode)
 
 	if (!(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode))) // 非普通文件/目录
 		return;
+	if (inode->i_index)
+		free_dir_index(inode);
 	for (i=0;i<7;i++)
 		if (inode->i_zone[i]) {
 			free_block(inode->i_dev,inode->i_zone[i]); // 前7项逻辑块对应的sb.zmap清0
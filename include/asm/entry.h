@@ -0,0 +1,29 @@
+#ifndef _ASM_ENTRY_H
+#define _ASM_ENTRY_H
+
+/*
+ * For the .S files only. Every way into the kernel takes the kernel lock
+ * (see smp.c) once its segment registers are set up, and gives it back
+ * just before it pops the registers again. ENTER_KERNEL keeps %eax,
+ * LEAVE_KERNEL changes %eax, %ecx and %edx like any C function does.
+ * Without CONFIG_SMP both are empty.
+ *
+ * GET_CURRENT loads current into %eax. It changes %ebx, which is what
+ * NEED_RESCHED uses afterwards: cpu n has loaded _TSS(n), (n+2)<<4.
+ */
+#include <linux/config.h>
+
+#ifdef CONFIG_SMP
+#define ENTER_KERNEL pushl %eax ; call _lock_kernel ; popl %eax
+#define LEAVE_KERNEL call _unlock_kernel
+#define GET_CURRENT xorl %ebx,%ebx ; str %bx ; shrl $4,%ebx ; \
+	movl _current_set-8(,%ebx,4),%eax
+#define NEED_RESCHED _need_resched_set-8(,%ebx,4)
+#else
+#define ENTER_KERNEL
+#define LEAVE_KERNEL
+#define GET_CURRENT movl _current,%eax
+#define NEED_RESCHED _need_resched
+#endif
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef _ASM_SPINLOCK_H
+#define _ASM_SPINLOCK_H
+
+/*
+ * Spinlocks for the critical sections that used to be plain cli/sti.
+ * cli only keeps out interrupts on this cpu; on a multiprocessor the
+ * other cpus have to be kept out with a lock as well, so the _irqsave
+ * versions do both. Without CONFIG_SMP the lock itself compiles away
+ * and what is left is exactly the old cli/sti (but nestable: the old
+ * interrupt flag is restored, not forced on).
+ *
+ * Never sleep with a spinlock held: drop it around sleep_on(), see
+ * lock_buffer() in ll_rw_blk.c.
+ */
+#include <linux/config.h>
+
+typedef struct {
+	volatile unsigned long lock;
+} spinlock_t;
+
+#define SPIN_LOCK_UNLOCKED { 0 }
+
+#ifdef CONFIG_SMP
+// 原子地置位 bit 0；已被占用就只读不写地自旋（rep;nop 即 pause），避免总线锁风暴
+#define spin_lock(l) \
+__asm__ volatile ("1:\tlock ; btsl $0,%0\n\t" \
+	"jnc 3f\n" \
+	"2:\trep ; nop\n\t" \
+	"testl $1,%0\n\t" \
+	"jne 2b\n\t" \
+	"jmp 1b\n" \
+	"3:":"+m" ((l)->lock)::"memory")
+
+#define spin_unlock(l) \
+__asm__ volatile ("movl $0,%0":"=m" ((l)->lock)::"memory")
+#else
+#define spin_lock(l) ((void)(l))
+#define spin_unlock(l) ((void)(l))
+#endif
+
+#define save_flags_cli(flags) \
+__asm__ volatile ("pushfl ; popl %0 ; cli":"=r" (flags)::"memory")
+
+#define restore_flags(flags) \
+__asm__ volatile ("pushl %0 ; popfl"::"r" (flags):"memory")
+
+#define spin_lock_irqsave(l,flags) \
+do { save_flags_cli(flags); spin_lock(l); } while (0)
+
+#define spin_unlock_irqrestore(l,flags) \
+do { spin_unlock(l); restore_flags(flags); } while (0)
+
+#endif
@@ -103,7 +103,7 @@ __asm__ ("movw $104,%1\n\t" /* limit[15:0], 段限长104，G=0，限长单位为
 	"rorl $16,%%eax" \
 	::"a" (addr), "m" (*(n)), "m" (*(n+2)), "m" (*(n+4)), \
 	 "m" (*(n+5)), "m" (*(n+6)), "m" (*(n+7)) \
-	)
+	:"memory")
 
 #define set_tss_desc(n,addr) _set_tssldt_desc(((char *) (n)),addr,"0x89")
 #define set_ldt_desc(n,addr) _set_tssldt_desc(((char *) (n)),addr,"0x82")
@@ -6,6 +6,34 @@
  * root-device by changing the line ROOT_DEV = XXX in boot/bootsect.s
  */
 
+/*
+ * HZ is the timer interrupt frequency. Anything from 19 to 1000 will do:
+ * LATCH (1193180/HZ) has to fit in the 16-bit counter of the 8253. It can
+ * also be given on the command line (-DHZ=1000).
+ *
+ * With TICKLESS_IDLE defined, the idle task programs the timer as a one-shot
+ * up to the next timer_list/alarm deadline and halts, instead of taking an
+ * interrupt every tick. Remove it to get the plain periodic tick back.
+ */
+#ifndef HZ
+#define HZ 100
+#endif
+#define TICKLESS_IDLE
+
+/*
+ * CONFIG_SMP builds the multiprocessor kernel: the other processors in
+ * the MP configuration table are started at boot (kernel/smp.c), and
+ * the spinlocks in <asm/spinlock.h> become real locks. That costs a
+ * locked instruction on every way into and out of the kernel, so it's
+ * off by default. NR_CPUS is the most processors it keeps track of.
+ */
+/*#define CONFIG_SMP */
+#ifdef CONFIG_SMP
+#define NR_CPUS 8
+#else
+#define NR_CPUS 1
+#endif
+
 /*
  * define your keyboard here -
  * KBD_FINNISH for Finnish keyboards
@@ -41,8 +41,7 @@ void buffer_init(long buffer_end);
 #define SUPER_MAGIC 0x137F
 
 #define NR_OPEN 20
-#define NR_INODE 32
-#define NR_FILE 64
+#define NR_INODE 32		/* at least this many in-core inodes are kept */
 #define NR_SUPER 8
 #define NR_HASH 307
 #define NR_BUFFERS nr_buffers
@@ -112,6 +111,11 @@ struct m_inode {    // memory i 节点 --> 通电使用
 	unsigned char i_mount; // 安装标志。
 	unsigned char i_seek; // 搜寻标志(lseek 时)。
 	unsigned char i_update;
+	struct task_struct * i_mmap;	/* tasks running this, see share_page() */
+	struct dir_index * i_index;	/* large directories, see namei.c */
+	struct m_inode * i_next;	/* all in-core inodes, see inode.c */
+	struct m_inode * i_hash_next, * i_hash_prev;
+	struct m_inode * i_lru_next, * i_lru_prev;	/* unused ones */
 };
 
 struct file {   // 一个文件一个 i 节点，一套在硬盘上，一套在内存中，内存的相比硬盘的多一些
@@ -142,6 +146,7 @@ struct super_block {
 	unsigned char s_lock;           // 被锁定标志
 	unsigned char s_rd_only;        // 只读标志
 	unsigned char s_dirt;           // 已修改(脏)标志
+	unsigned short s_rotor;         // new_block() 上次找到的位置（位图中的位）
 };
 
 struct d_super_block {
@@ -160,8 +165,7 @@ struct dir_entry { // 针对目录，共16字节。如果一个目录文件占
 	char name[NAME_LEN];
 };
 
-extern struct m_inode inode_table[NR_INODE];
-extern struct file file_table[NR_FILE];
+extern struct m_inode * first_inode;
 extern struct super_block super_block[NR_SUPER];
 extern struct buffer_head * start_buffer;
 extern int nr_buffers;
@@ -183,14 +187,27 @@ extern void iput(struct m_inode * inode);
 extern struct m_inode * iget(int dev,int nr);
 extern struct m_inode * get_empty_inode(void);
 extern struct m_inode * get_pipe_inode(void);
+extern void insert_inode_hash(struct m_inode * inode);
+extern void remove_inode_hash(struct m_inode * inode);
+extern struct file * get_empty_filp(void);
+extern void put_filp(struct file * f);
+extern unsigned long dcache_seq;
+extern int dcache_lookup(int dev, int dir, const char * name, int len);
+extern void dcache_add(int dev, int dir, const char * name, int len, int ino);
+extern void dcache_remove(int dev, int dir, const char * name, int len);
+extern void dcache_invalidate(int dev, int dir);
+extern void free_dir_index(struct m_inode * dir);
 extern struct buffer_head * get_hash_table(int dev, int block);
 extern struct buffer_head * getblk(int dev, int block);
 extern void ll_rw_block(int rw, struct buffer_head * bh);
+extern void ll_rw_page(int rw, int dev, int page, char * buffer);
 extern void brelse(struct buffer_head * buf);
 extern struct buffer_head * bread(int dev,int block);
 extern void bread_page(unsigned long addr,int dev,int b[4]);
+extern int cached_page(unsigned long addr,int dev,int b[4]);
+extern void breada_page(int dev,int b[4]);
 extern struct buffer_head * breada(int dev,int block,...);
-extern int new_block(int dev);
+extern int new_block(int dev, int goal);
 extern void free_block(int dev, int block);
 extern struct m_inode * new_inode(int dev);
 extern void free_inode(struct m_inode * inode);
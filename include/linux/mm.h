@@ -1,10 +1,168 @@
 #ifndef _MM_H
 #define _MM_H
 
+#include <linux/config.h>
+
 #define PAGE_SIZE 4096
 
+/*
+ * Every task has a page directory of its own (task->tss.cr3). The first
+ * KERNEL_PGD_ENTRIES entries hold the kernel's identity mapping of
+ * physical memory and are the same in all of them. User code and data
+ * segments all start at TASK_BASE and can be up to TASK_SIZE long, so
+ * neither the number of tasks nor their size is tied to the 4GB linear
+ * space any more.
+ */
+#define TASK_BASE 0x40000000
+#define TASK_SIZE 0xc0000000
+#define KERNEL_PGD_ENTRIES (TASK_BASE>>22)
+
+/* these are not to be changed without changing head.s etc */
+#define LOW_MEM 0x100000 // 扩展内存对应物理地址的开始地址（多于1MB的内存为扩展内存）
+#define MAP_NR(addr) (((addr)-LOW_MEM)>>12)
+#define ZERO_PAGE ((unsigned long) empty_zero_page)
+
+#define PAGE_PRESENT	0x01
+#define PAGE_RW		0x02
+#define PAGE_USER	0x04
+#define PAGE_ACCESSED	0x20
+#define PAGE_DIRTY	0x40
+#define PAGE_SHARED_FILE 0x200	/* available bit: MAP_SHARED page, never swapped */
+
+/*
+ * The page-directory entry that maps linear address 'addr' for task p.
+ * Page directories (and page tables) are in identity-mapped memory, so
+ * their physical address can be used directly.
+ */
+#define pg_dir_entry(p,addr) (((unsigned long *) (p)->tss.cr3) + ((addr)>>22))
+
+// 刷新页变换高速缓冲宏函数。 
+// 为了提高地址转换的效率，CPU 将最近使用的页表数据存放在芯片中高速缓冲中。在修改过页表信息之后，就需要刷新该缓冲区。这里使用重新加载页目录基址寄存器 cr3 的方法来进行刷新。
+#define invalidate() \
+__asm__("movl %%eax,%%cr3"::"a" (current->tss.cr3)) // "a" 赋值 eax = 当前进程的页目录
+
+/*
+ * When only the mapping of one linear address has changed, only its TLB
+ * entry has to go: invlpg (%eax), spelled out in bytes. It's a 486
+ * instruction, so a 386 still reloads cr3.
+ */
+extern int has_invlpg;
+
+#define invalidate_page(addr) \
+do { \
+if (has_invlpg) \
+	__asm__ __volatile__(".byte 0x0f,0x01,0x38"::"a" (addr):"memory"); \
+else \
+	invalidate(); \
+} while (0)
+
+extern unsigned long HIGH_MEMORY;
+extern unsigned long paging_pages;
+extern unsigned char * mem_map;
+
 extern unsigned long get_free_page(void);
+extern unsigned long get_dirty_page(void);
+extern unsigned long get_user_page(void);
+extern unsigned long get_dirty_user_page(void);
+extern void zero_idle_pages(void);
+extern unsigned long get_free_pages(int order);
+extern void free_pages(unsigned long addr, int order);
+extern long nr_free_pages;
 extern unsigned long put_page(unsigned long page,unsigned long address);
+extern unsigned long put_dirty_page(unsigned long page,unsigned long address);
 extern void free_page(unsigned long addr);
+extern unsigned long new_page_dir(void);
+
+/*
+ * High memory: physical memory from highmem_start (at most PKMAP_BASE)
+ * up is not mapped by the kernel, and only holds pages of user space,
+ * from get_user_page(). kmap() maps any page into the last 4MB below
+ * TASK_BASE and returns the address to use, kunmap() gives it back.
+ * Pages below highmem_start are their own address. kmap() may sleep.
+ *
+ * With CONFIG_SMP the last slot maps the local APIC instead (smp.c),
+ * and pkmap_flushes counts the TLB flushes of kmap(), which the other
+ * cpus catch up on when they next take the kernel lock.
+ */
+#define PKMAP_BASE (TASK_BASE-0x400000)
+#ifdef CONFIG_SMP
+#define NR_PKMAP 1023
+extern unsigned long pkmap_flushes;
+#else
+#define NR_PKMAP 1024
+#endif
+
+extern unsigned long highmem_start;
+extern long nr_free_highpages;
+extern unsigned long * pkmap_table;
+extern unsigned long kmap(unsigned long page);
+extern void kunmap(unsigned long addr);
+
+/*
+ * Swap. A page that has been swapped out leaves a page table entry with
+ * the present bit clear and the swap page number above it (nr<<1); an
+ * entry that is 0 was never there.
+ */
+extern int swap_out(void);
+extern void swap_in(unsigned long * table_ptr);
+extern void swap_free(int swap_nr);
+extern int swap_dup(unsigned long * from_entry, unsigned long * to_entry);
+
+/*
+ * kswapd runs swap_out() in the background: get_free_pages() wakes it
+ * when free memory drops below FREE_PAGES_LOW, and it goes on until
+ * there are FREE_PAGES_HIGH free, so that allocation seldom has to.
+ */
+#define FREE_PAGES_LOW	32
+#define FREE_PAGES_HIGH	64
+
+extern struct task_struct * kswapd_wait;
+extern void kswapd_init(void);
+
+/*
+ * mmap(). A task has up to NR_MMAP mapped files, each a vm_area in its
+ * task_struct; the pages are read in by do_no_page(). Mappings go from
+ * MMAP_BASE (relative to the data segment) up to MMAP_END, which keeps
+ * the address mmap() returns positive. brk stays below MMAP_BASE, and
+ * the stack is above MMAP_END.
+ */
+#define NR_MMAP 8
+#define MMAP_BASE 0x40000000
+#define MMAP_END 0x80000000
+
+struct vm_area {
+	unsigned long start, end;	/* linear addresses, page aligned */
+	struct m_inode * inode;		/* NULL if the slot is free */
+	unsigned long offset;		/* file offset of 'start' */
+	unsigned short prot, flags;
+};
+
+extern void unshare_pg_table(unsigned long address);
+extern int mmap_no_page(unsigned long error_code, unsigned long address);
+extern int mmap_wp_page(unsigned long * table_entry, unsigned long address);
+extern void exit_mmap(void);
+
+/*
+ * Object caches, see mm/slab.c. A cache is a static struct, set up with
+ * KMEM_CACHE(), so there is nothing to initialize before it's used.
+ */
+#define L1_CACHE_BYTES 32
+#define L1_CACHE_ALIGN(x) (((x)+L1_CACHE_BYTES-1) & ~(L1_CACHE_BYTES-1))
+
+struct slab;
+
+struct kmem_cache {
+	char * name;
+	int size;			/* object size, cache-line aligned */
+	void (*ctor)(void * objp);
+	struct slab * partial;		/* slabs with free objects */
+	int nr_slabs, nr_objs;
+};
+
+#define KMEM_CACHE(name,type,ctor) \
+{ (name), L1_CACHE_ALIGN(sizeof(type)), (ctor), NULL, 0, 0 }
+
+extern void * kmem_cache_alloc(struct kmem_cache * cachep);
+extern void kmem_cache_free(struct kmem_cache * cachep, void * objp);
 
 #endif
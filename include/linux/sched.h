@@ -1,8 +1,15 @@
 #ifndef _SCHED_H
 #define _SCHED_H
 
-#define NR_TASKS 64
-#define HZ 100
+#include <linux/config.h>
+
+#define NR_TASKS 256
+
+#if (HZ < 19 || HZ > 1000)
+#error "HZ out of range: LATCH must fit in the 8253 counter"
+#endif
+
+#define LATCH (1193180/HZ)
 
 #define FIRST_TASK task[0]
 #define LAST_TASK task[NR_TASKS-1]
@@ -10,6 +17,7 @@
 #include <linux/head.h>
 #include <linux/fs.h>
 #include <linux/mm.h>
+#include <linux/smp.h>
 #include <signal.h>
 
 #if (NR_OPEN > 32)
@@ -26,9 +34,6 @@
 #define NULL ((void *) 0)
 #endif
 
-extern int copy_page_tables(unsigned long from, unsigned long to, long size);
-extern int free_page_tables(unsigned long from, unsigned long size);
-
 extern void sched_init(void);
 extern void schedule(void);
 extern void trap_init(void);
@@ -91,6 +96,9 @@ struct task_struct {
 	unsigned short uid,euid,suid;
 	unsigned short gid,egid,sgid;
 	long alarm; // 报警定时值（滴答数）
+	long alarm_interval;	/* ticks, reloads alarm (ualarm) */
+	long policy,rt_priority;	/* SCHED_OTHER/FIFO/RR, 1..99 if real-time */
+	unsigned long wake_stamp;	/* 8253 clocks at wakeup, 0 if not woken */
 	long utime,stime,cutime,cstime,start_time;
 	unsigned short used_math;
 /* file system info */
@@ -104,9 +112,30 @@ struct task_struct {
 /* ldt for this task 0 - zero 1 - cs 2 - ds&ss */
 	struct desc_struct ldt[3]; // 0-空，1-代码段 cs，2-数据和堆栈段 ds&ss。
 /* tss for this task */
-	struct tss_struct tss;
+	struct tss_struct tss; // 软件切换：只用 esp0、ldt、i387，esp/eip 保存内核栈现场
+/* vfork: the child runs in the parent's page directory until exec/exit */
+	struct task_struct * vfork_parent;	/* set in the child meanwhile */
+	struct task_struct * vfork_wait;	/* the parent sleeps here */
+/* the other tasks running the same executable: executable->i_mmap */
+	struct task_struct * mmap_next, * mmap_prev;
+	struct vm_area mmap[NR_MMAP];	/* mmap()ed files */
+/* page faults: no i/o needed, i/o needed, copy-on-write copies */
+	long min_flt, maj_flt, cow_flt;
+/* smp: the cpu whose run queue we're on, kernel lock nesting */
+	int processor;
+	int lock_depth;
 };
 
+extern int copy_page_tables(unsigned long from, unsigned long to,
+	unsigned long size, struct task_struct * p);
+extern int free_page_tables(unsigned long from, unsigned long size);
+extern void free_page_dir(struct task_struct * p);
+extern void vfork_release(unsigned long dir);
+extern int kernel_thread(void (*fn)(void));
+extern long task_rss(struct task_struct * p);
+extern void add_mapping(struct task_struct * p);
+extern void del_mapping(struct task_struct * p);
+
 /*
  *  INIT_TASK is used to set up the first task table, touch at
  * your own risk!. Base=0, limit=0x9ffff (=640kB)
@@ -123,7 +152,7 @@ struct task_struct {
 /* ec,brk... */	0,0,0,0,0,0, \
 /* pid etc.. */	0,-1,0,0,0, /* 进程号为0 */ \
 /* uid etc */	0,0,0,0,0,0, \
-/* alarm */	0,0,0,0,0,0, \
+/* alarm */	0,0,0,0,0,0,0,0,0,0, \
 /* math */	0, \
 /* fs info */	-1,0022,NULL,NULL,NULL,0, /* 进程0 的 pwd, root, executable 都是 NULL, 即进程0不挂载任何文件系统 */\
 /* filp */	{NULL,}, \
@@ -132,7 +161,7 @@ struct task_struct {
 		{0x9f,0xc0fa00}, \
 		{0x9f,0xc0f200}, \
 	}, \
-/*tss*/	{0,PAGE_SIZE+(long)&,0x10,0,0,0,0,(long)&pg_dir,\
+/*tss*/	{0,PAGE_SIZE+(long)&init_task,0x10,0,0,0,0,(long)&pg_dir,\
 	 0,0,0,0,0,0,0,0, /* 这行第二个0是EFLAGS，赋值为0，也关了中断（决定了cli这类指令只能在0特权级使用）, IF为0，IOPL也为0 */\
 	 0,0,0x17,0x17,0x17,0x17,0x17,0x17, \
 	 _LDT(0),0x80000000, \
@@ -141,55 +170,124 @@ struct task_struct {
 }
 
 extern struct task_struct *task[NR_TASKS];
+
+/*
+ * On a multiprocessor these are per cpu: each cpu has its own current
+ * task, idle task, fpu owner and need_resched. task[0] is the idle task
+ * of the boot cpu, the others have theirs in idle_set[] only.
+ */
+#ifdef CONFIG_SMP
+extern struct task_struct *current_set[NR_CPUS];
+extern struct task_struct *idle_set[NR_CPUS];
+extern struct task_struct *last_math_set[NR_CPUS];
+extern int need_resched_set[NR_CPUS];
+#define current (current_set[smp_processor_id()])
+#define last_task_used_math (last_math_set[smp_processor_id()])
+#define need_resched (need_resched_set[smp_processor_id()])
+#define idle_task(cpu) (idle_set[cpu])
+#else
 extern struct task_struct *last_task_used_math;
 extern struct task_struct *current;
+extern int need_resched;
+#define idle_task(cpu) ((void)(cpu),task[0])
+#endif
 extern long volatile jiffies;
 extern long startup_time;
 
 #define CURRENT_TIME (startup_time+jiffies/HZ)
 
+/*
+ * Voluntary preemption point for long loops in the kernel. Only to be
+ * used where nothing is locked and nothing half-done can be seen by
+ * whoever runs next.
+ */
+#define cond_resched() do { if (need_resched) schedule(); } while (0)
+
 extern void add_timer(long jiffies, void (*fn)(void));
 extern void sleep_on(struct task_struct ** p);
 extern void interruptible_sleep_on(struct task_struct ** p);
 extern void wake_up(struct task_struct ** p);
 
 /*
- * Entry into gdt where to find first TSS. 0-nul, 1-cs, 2-ds, 3-syscall
- * 4-TSS0, 5-LDT0, 6-TSS1 etc ...
+ * Entry into gdt where to find the TSS. 0-nul, 1-cs, 2-ds, 3-syscall
+ * 4-TSS, 5-LDT
+ *
+ * Tasks are switched in software, so there is only one TSS per cpu
+ * (init_tss[cpu]), at 4+2*cpu, and one LDT descriptor per cpu after it:
+ * switch_to() points it at the ldt of the next task. Neither limits
+ * NR_TASKS.
  */
 #define FIRST_TSS_ENTRY 4
 #define FIRST_LDT_ENTRY (FIRST_TSS_ENTRY+1)
-// _TSS(1)=0b110000, 110（6,GDT中TSS0的下标）|0 GDT|00 特权级
 #define _TSS(n) ((((unsigned long) n)<<4)+(FIRST_TSS_ENTRY<<3))
 #define _LDT(n) ((((unsigned long) n)<<4)+(FIRST_LDT_ENTRY<<3))
 #define ltr(n) __asm__("ltr %%ax"::"a" (_TSS(n)))
-#define lldt(n) __asm__("lldt %%ax"::"a" (_LDT(n)))
-#define str(n) \
-__asm__("str %%ax\n\t" \
-	"subl %2,%%eax\n\t" \
-	"shrl $4,%%eax" \
-	:"=a" (n) \
-	:"a" (0),"i" (FIRST_TSS_ENTRY<<3))
+#define lldt(n) __asm__("lldt %%ax"::"a" (_LDT(n)):"memory")
+
+extern struct tss_struct init_tss[NR_CPUS];
+
+/*
+ * On a multiprocessor the math state can't be left in the fpu when a
+ * task is switched out, as it may go on on another cpu: it's saved
+ * right away instead.
+ */
+#ifdef CONFIG_SMP
+#define unlazy_fpu(tsk) \
+if (last_task_used_math == (tsk)) { \
+	__asm__("fnsave %0 ; fwait"::"m" ((tsk)->tss.i387)); \
+	last_task_used_math = NULL; \
+}
+#else
+#define unlazy_fpu(tsk)
+#endif
+
 /*
- *	switch_to(n) should switch tasks to task nr n, first
- * checking that n isn't the current task, in which case it does nothing.
+ *	switch_to(tsk) should switch tasks to task tsk, first
+ * checking that tsk isn't the current task, in which case it does nothing.
  * This also clears the TS-flag if the task we switched to has used
  * tha math co-processor latest.
+ *
+ * It is done in software instead of with a TSS task switch: only the
+ * kernel stack is changed. The registers gcc doesn't save for us, the
+ * flags and %fs/%gs are pushed on the old stack, which is remembered in
+ * prev->tss.esp together with the place to resume at (prev->tss.eip).
+ * %fs and %gs have to be reloaded anyway, as they are LDT selectors,
+ * and the LDT descriptor and cr3 are changed to those of the next task.
+ * A new task resumes at ret_from_fork instead of at 1: below.
  */
-// 进程切换，类似于任务门切换，tss 段的切换
-#define switch_to(n) {\
-struct {long a,b;} __tmp; /* 为ljmp的CS、EIP准备的数据结构 */\
-__asm__("cmpl %%ecx,_current\n\t" /* 如果 n 为当前进程，没必要切换，直接退出 */\
-	"je 1f\n\t" \
-	"movw %%dx,%1\n\t" /* 段选择符 -> b */\
-	"xchgl %%ecx,_current\n\t" /* _current 和 %%ecx 交换 */\
-	"ljmp %0\n\t" /* long jmp %0,即参数中的段选择子，即先保存下条指令地址即eip+4到进程0的tss，恢复进程1的所有 tss 数据，无需偏移量。在此之前是进程0的内核态，在此之后是进程1的用户态，下列的代码不执行，由此产生任务切换。此时 sys pause->schedule->switch_to，还没有清栈，待到切换回进程0时，基于保存的 eip 调用下列代码，返回所有函数并清栈*/\
-	"cmpl %%ecx,_last_task_used_math\n\t" /* 重要！进程0再次被调度时，回到的地方。判断原任务使用过协处理器吗，没有则跳转 */\
-	"jne 1f\n\t" \
-	"clts\n" /* 清 cr0 的 TS 标志，task swap */\
-	"1:" \
-	::"m" (*&__tmp.a),"m" (*&__tmp.b), /* %0 a是偏移量EIP，%1 b是段选择子CS，这里只赋值了b */\
-	"d" (_TSS(n)),"c" ((long) task[n])); /* dx=_TSS(n)，即TSS n的索引号+权限，即其段选择符； ecx=task[n] */\
+#define switch_to(tsk) {\
+struct task_struct * __prev = current, * __next = (tsk); \
+int __cpu = smp_processor_id(); \
+long __d0,__d1,__d2,__d3; \
+if (__next != __prev) { \
+	unlazy_fpu(__prev); \
+	init_tss[__cpu].esp0 = __next->tss.esp0; /* 下一个进程的内核栈 */\
+	set_ldt_desc(gdt+FIRST_LDT_ENTRY+2*__cpu,&(__next->ldt)); \
+	lldt(__cpu); \
+	if (__next->tss.cr3 != __prev->tss.cr3) /* 下一个进程的页目录 */\
+		__asm__("movl %%eax,%%cr3"::"a" (__next->tss.cr3):"memory"); \
+	if (last_task_used_math == __next) \
+		__asm__("clts"); \
+	else /* 置 cr0 的 TS 位，用到协处理器时再恢复 */\
+		__asm__("movl %%cr0,%%eax ; orl $8,%%eax ; movl %%eax,%%cr0":::"ax"); \
+	current = __next; \
+	__asm__("pushfl\n\t" \
+		"pushl %%ebp\n\t" \
+		"push %%fs\n\t" \
+		"push %%gs\n\t" \
+		"movl %%esp,(%%eax)\n\t" /* prev->tss.esp */\
+		"movl $1f,(%%ebx)\n\t" /* prev->tss.eip */\
+		"movl %%edx,%%esp\n\t" /* 换到 next 的内核栈 */\
+		"jmp *%%esi\n" /* 1: 或 ret_from_fork */\
+		"1:\tpop %%gs\n\t" /* 重要！进程再次被调度时，回到的地方 */\
+		"pop %%fs\n\t" \
+		"popl %%ebp\n\t" \
+		"popfl" \
+		:"=a" (__d0),"=b" (__d1),"=d" (__d2),"=S" (__d3) \
+		:"0" (&__prev->tss.esp),"1" (&__prev->tss.eip), \
+		 "2" (__next->tss.esp),"3" (__next->tss.eip) \
+		:"cx","di","memory"); \
+} \
 }
 
 #define PAGE_ALIGN(n) (((n)+0xfff)&0xfffff000)
@@ -0,0 +1,39 @@
+#ifndef _SMP_H
+#define _SMP_H
+
+#include <linux/config.h>
+
+#ifdef CONFIG_SMP
+struct task_struct;
+
+extern int smp_num_cpus;
+extern int cpu_apic_id[NR_CPUS];
+extern unsigned long apic_addr;
+extern unsigned long io_apic_addr;
+
+extern void smp_init(void);
+extern void smp_send_reschedule(int cpu);
+extern void lock_kernel(void);
+extern void unlock_kernel(void);
+extern int dir_in_use(struct task_struct * p);
+
+/*
+ * The cpu we're on, from the TSS it has loaded: cpu n uses _TSS(n).
+ * TR is still 0 until sched_init() has loaded it, and that's the boot
+ * cpu too. Not to be kept across schedule(), the task may come back on
+ * another cpu.
+ */
+#define smp_processor_id() ({ \
+unsigned long __tr; \
+__asm__ __volatile__("str %%ax":"=a" (__tr):"0" (0)); \
+__tr ? (int) ((__tr - _TSS(0)) >> 4) : 0; })
+#else
+#define smp_num_cpus 1
+#define smp_init() do { } while (0)
+#define smp_processor_id() 0
+#define lock_kernel() do { } while (0)
+#define unlock_kernel() do { } while (0)
+#define dir_in_use(p) 0
+#endif
+
+#endif
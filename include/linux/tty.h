@@ -1,7 +1,7 @@
 /*
  * 'tty.h' defines some structures used by tty_io.c and some defines.
  *
- * NOTE! Don't touch this without checking that nothing in rs_io.s or
+ * NOTE! Don't touch this without checking that nothing in rs_io.S or
  * con_io.s breaks. Some constants are hardwired into the system (mainly
  * offsets into 'tty_queue'
  */
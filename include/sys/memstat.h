@@ -0,0 +1,13 @@
+#ifndef _SYS_MEMSTAT_H
+#define _SYS_MEMSTAT_H
+
+struct memstat {
+	long ms_rss;		/* pages present */
+	long ms_minflt;		/* page faults that needed no i/o */
+	long ms_majflt;		/* page faults that had to read */
+	long ms_cowflt;		/* copy-on-write copies made */
+};
+
+extern int memstat(int pid, struct memstat * buf);
+
+#endif
@@ -29,6 +29,12 @@
 #define SEEK_CUR	1 // 从文件当前读写位置处开始偏移
 #define SEEK_END	2 // 表明从文件尾端开始偏移
 
+/* sched_setscheduler() policies */
+#define SCHED_OTHER	0 // 普通进程：counter/priority 时间片调度
+#define SCHED_FIFO	1 // 实时：先进先出，无时间片，直到阻塞或让出
+#define SCHED_RR	2 // 实时：同优先级轮转，时间片为 priority
+#define SCHED_RT_MAX	99 // 实时优先级 1..99，越大越优先
+
 /* _SC stands for System Configuration. We don't use them much */
 #define _SC_ARG_MAX		1
 #define _SC_CHILD_MAX		2
@@ -131,6 +137,13 @@
 #define __NR_ssetmask	69
 #define __NR_setreuid	70
 #define __NR_setregid	71
+#define __NR_ualarm	72
+#define __NR_sched_setscheduler	73
+#define __NR_swapon	74
+#define __NR_vfork	75
+#define __NR_mmap	76
+#define __NR_munmap	77
+#define __NR_memstat	78
 
 /*
 volatile:	防止 C++ 内存优化，即存取都从内存中调用，而不是 cache
@@ -144,7 +157,7 @@ long __res; \
 __asm__ volatile ("int $0x80" /* int $0x80 调用 _system_call */\
 	: "=a" (__res) \
 	: "0" (__NR_##name)); /* __NR_fork 为2 */\
-if (__res >= 0) /* int $0x80 压栈时的 eip; 跳转到进程1时，经过这里的 _res 为0，见kernel/fork.c line107: `p->tss.eax = 0;` 故最后返回0 【FLAG：进程1被调度时，回到的现场】*/\
+if (__res >= 0) /* int $0x80 压栈时的 eip; 跳转到进程1时，经过这里的 _res 为0，见kernel/fork.c copy_process() 为子进程内核栈上的 eax 填 0，故最后返回0 【FLAG：进程1被调度时，回到的现场】*/\
 	return (type) __res; /* 返回到 main.fork */\
 errno = -__res; \
 return -1; \
@@ -243,6 +256,10 @@ int sync(void);
 time_t time(time_t * tloc);
 time_t times(struct tms * tbuf);
 int ulimit(int cmd, long limit);
+long ualarm(long usecs, long interval);
+int sched_setscheduler(pid_t pid, int policy, int rt_priority);
+int swapon(const char * specialfile);
+pid_t vfork(void);
 mode_t umask(mode_t mask);
 int umount(const char * specialfile);
 int uname(struct utsname * name);
@@ -28,6 +28,7 @@ static inline _syscall0(int,sync)
 #include <linux/tty.h>
 #include <linux/sched.h>
 #include <linux/head.h>
+#include <linux/smp.h>
 #include <asm/system.h>
 #include <asm/io.h>
 
@@ -43,11 +44,11 @@ static char printbuf[1024];
 
 extern int vsprintf();
 extern void init(void);
-extern void blk_dev_init(void);
 extern void chr_dev_init(void);
 extern void hd_init(void);
 extern void floppy_init(void);
-extern void mem_init(long start, long end);
+extern void mem_init(unsigned long start, unsigned long end);
+extern unsigned long paging_init(unsigned long start, unsigned long end);
 extern long rd_init(long mem_start, int length);
 extern long kernel_mktime(struct tm * tm);
 extern long startup_time;
@@ -57,6 +58,7 @@ extern long startup_time;
  * 放置机器系统数据，0x90002 表示扩展内存（系统从1MB开始的扩展内存数值/KB）
  */
 #define EXT_MEM_K (*(unsigned short *)0x90002)
+#define EXT_MEM_64K (*(unsigned short *)0x90012) // E801：16MB 以上的内存，以 64KB 计，0 表示不知道
 #define DRIVE_INFO (*(struct drive_info *)0x90080)
 #define ORIG_ROOT_DEV (*(unsigned short *)0x901FC) // 根文件系统所在设备号
 
@@ -96,9 +98,9 @@ static void time_init(void)
 	startup_time = kernel_mktime(&time);
 }
 
-static long memory_end = 0;
-static long buffer_memory_end = 0;
-static long main_memory_start = 0;
+static unsigned long memory_end = 0;
+static unsigned long buffer_memory_end = 0;
+static unsigned long main_memory_start = 0;
 
 struct drive_info { char dummy[32]; } drive_info;
 
@@ -110,12 +112,17 @@ void main(void)		/* This really IS void, no error here. */
  */
  	ROOT_DEV = ORIG_ROOT_DEV; // 初始为软盘
  	drive_info = DRIVE_INFO;
-	memory_end = (1<<20) + (EXT_MEM_K<<10);
+	if (EXT_MEM_64K >= 0xff00)
+		memory_end = 0xfffff000; // 4GB，最后一页不要，免得地址回绕
+	else if (EXT_MEM_64K)
+		memory_end = 16*1024*1024 + ((unsigned long) EXT_MEM_64K<<16); // 1GB 以上是高端内存，见 mm/highmem.c
+	else
+		memory_end = (1<<20) + (EXT_MEM_K<<10);
 	memory_end &= 0xfffff000;
 	// 针对物理内存条的实际大小，对内存进行不同的规划
-	if (memory_end > 16*1024*1024)
-		memory_end = 16*1024*1024;
-	if (memory_end > 12*1024*1024) 
+	if (memory_end > 32*1024*1024)
+		buffer_memory_end = 8*1024*1024;
+	else if (memory_end > 12*1024*1024) 
 		buffer_memory_end = 4*1024*1024; // 0x3FFFFF
 	else if (memory_end > 6*1024*1024)
 		buffer_memory_end = 2*1024*1024;
@@ -129,17 +136,19 @@ void main(void)		/* This really IS void, no error here. */
 	// AKA. rd 虚拟盘设置
 	main_memory_start += rd_init(main_memory_start, RAMDISK*1024);
 #endif
+	main_memory_start = paging_init(main_memory_start,memory_end);
 	mem_init(main_memory_start,memory_end);
 	trap_init();
-	blk_dev_init();
 	chr_dev_init();     // 字符设备，标准输入输出
 	tty_init();         // 电传打印机(Teleprinter)
 	time_init();        // 系统时钟设置
 	sched_init();       // 进程设置+系统调用相关【重要】
+	smp_init();         // 找 MP 配置表，启动其它 CPU；拿着内核锁
 	buffer_init(buffer_memory_end); // 普通文件块设备的缓冲区->为了跑得更快
 	hd_init();          // 初始化硬盘
 	floppy_init();      // 初始化软盘
 	sti();              // 因为在 setup.s line 109 关闭了中断
+	unlock_kernel();    // 放开 smp_init() 拿的内核锁，其它 CPU 从这里开始干活
 	move_to_user_mode();// 转换特权级 0->3，进程0开始执行，之后的代码均为进程0来执行
     // NOTE lyq: 考题，fork 这里面的 static inline _syscall0(int,fork) inline 去不去掉的区别
 	if (!fork()) {		/* we count on this going ok 创建进程 */
@@ -182,7 +191,7 @@ void init(void)
 	(void) dup(0); // 标准错误输出设备
 	printf("%d buffers = %d bytes buffer space\n\r",NR_BUFFERS,
 		NR_BUFFERS*BLOCK_SIZE); // 重要！！首次使用 printf，在标准输出设备支持下，显示信息
-	printf("Free mem: %d bytes\n\r",memory_end-main_memory_start);
+	printf("Free mem: %u bytes\n\r",memory_end-main_memory_start);
 	if (!(pid=fork())) { // NOTE lyq: 所有父进程创建子进程，子进程加载自己的文件的必备流程
 		// 这里由子进程 进程2 执行。该子进程关闭了句柄0(stdin)、以只读方式打开 /etc/rc 文件，并使用 execve()函数将进程自身替换成 /bin/sh 程序(即 shell 程序)，然后执行 /bin/sh 程序
 		// 函数_exit()退出时的出错码 1 – 操作未许可；2 -- 文件或目录不存在。
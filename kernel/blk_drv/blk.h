@@ -3,9 +3,10 @@
 
 #define NR_BLK_DEV	7
 /*
- * NR_REQUEST is the number of entries in the request-queue.
- * NOTE that writes may use only the low 2/3 of these: reads
- * take precedence. 写操作仅使用这些项低端的 2/3；读操作优先处理。
+ * NR_REQUEST is how many requests may be queued before writes and
+ * read-aheads have to wait (requests are allocated, see ll_rw_blk.c).
+ * NOTE that writes may use only 2/3 of these: reads
+ * take precedence. 写操作仅使用其中的 2/3；读操作优先处理。
  *
  * 32 seems to be a reasonable number: enough to get some benefit
  * from the elevator-mechanism, but not so much as to lock a lot of
@@ -26,7 +27,7 @@
  * 请求项：进程数据与硬盘、软盘、其他外设等的交互，都需要由请求项管理
  */
 struct request {
-	int dev;		/* -1 if no request 使用的设备号 */
+	int dev;		/* -1 once freed 使用的设备号 */
 	int cmd;		/* READ or WRITE */
 	int errors;                             // 操作时产生的错误次数
 	unsigned long sector;                   // 起始扇区。(1 块=2 扇区)
@@ -55,8 +56,8 @@ struct blk_dev_struct {
 };
 
 extern struct blk_dev_struct blk_dev[NR_BLK_DEV];
-extern struct request request[NR_REQUEST]; // 数组+链表（req.next）
 extern struct task_struct * wait_for_request;
+extern void free_request(struct request * req);
 
 #ifdef MAJOR_NR
 
@@ -115,6 +116,8 @@ extern inline void unlock_buffer(struct buffer_head * bh) // 解锁缓冲块
 
 extern inline void end_request(int uptodate)
 {
+	struct request * req;
+
 	DEVICE_OFF(CURRENT->dev); // 关闭设备
 	if (CURRENT->bh) {
 		CURRENT->bh->b_uptodate = uptodate; // 置更新标志
@@ -122,13 +125,17 @@ extern inline void end_request(int uptodate)
 	}
 	if (!uptodate) { // 如果更新标志为 0 则显示设备错误信息
 		printk(DEVICE_NAME " I/O error\n\r");
-		printk("dev %04x, block %d\n\r",CURRENT->dev,
-			CURRENT->bh->b_blocknr);
+		if (CURRENT->bh)
+			printk("dev %04x, block %d\n\r",CURRENT->dev,
+				CURRENT->bh->b_blocknr);
+		else
+			printk("dev %04x, sector %d\n\r",CURRENT->dev,
+				CURRENT->sector);
 	}
-	wake_up(&CURRENT->waiting); // 唤醒等待该请求项的进程。0.11 没有使用它，make_request中置为NULL
-	wake_up(&wait_for_request); // 唤醒等待请求的进程
-	CURRENT->dev = -1; 		 // 请求项状态：占用-->空闲 （其实这一步会被下一步覆盖的）
-	CURRENT = CURRENT->next; // 将当前请求项设置为下一个，为处理剩余请求项做准备
+	wake_up(&CURRENT->waiting); // 唤醒等待该请求项的进程，ll_rw_page() 用它
+	req = CURRENT;
+	CURRENT = req->next; // 将当前请求项设置为下一个，为处理剩余请求项做准备
+	free_request(req); // 还给 request 缓存，并唤醒等待请求的进程
 }
 
 #define INIT_REQUEST /* 判断是否还有剩余的请求项 */\
@@ -409,7 +409,7 @@ static void floppy_on_interrupt(void)
 		current_DOR &= 0xFC;
 		current_DOR |= current_drive;
 		outb(current_DOR,FD_DOR);
-		add_timer(2,&transfer);
+		add_timer((HZ+49)/50,&transfer);	/* 20ms, at least one tick */
 	} else
 		transfer();
 }
@@ -160,6 +160,7 @@ int sys_setup(void * BIOS)
 		printk("Partition table%s ok.\n\r",(NR_HD>1)?"s":"");
 	rd_load(); // 虚拟盘代替软盘，是指称为根设备
 	mount_root(); // 把虚拟文件的根设备加载到文件系统
+	kswapd_init(); // 启动内核线程 kswapd，后台回收页面
 	return (0);
 }
 
@@ -10,7 +10,9 @@
 #include <errno.h>
 #include <linux/sched.h>
 #include <linux/kernel.h>
+#include <linux/mm.h>
 #include <asm/system.h>
+#include <asm/spinlock.h>
 
 #include "blk.h"
 
@@ -18,8 +20,28 @@
  * The request-struct contains all necessary data
  * to load a nr of sectors into memory
  * 请求结构包含将扇区加载到内存中的所有必要数据
+ *
+ * Requests come from a slab cache, and end_request() gives them back
+ * with free_request(). nr_requests is how many are out.
+ */
+static struct kmem_cache request_cache =
+	KMEM_CACHE("request",struct request,NULL);
+static int nr_requests = 0;
+
+/*
+ * The request for writing out a page to swap. Swapping out is what
+ * frees memory, so it mustn't need any: getting a request from the
+ * cache can go to swap_out() for a page, and that waits for the write
+ * in progress, which is our own. swap_out() writes one page at a time,
+ * so one request is enough. It doesn't count in nr_requests.
  */
-struct request request[NR_REQUEST];
+static struct request swap_request = { -1, };
+
+/*
+ * blk_lock protects nr_requests, the per-device request lists and
+ * b_lock of buffers on their way to the driver.
+ */
+static spinlock_t blk_lock = SPIN_LOCK_UNLOCKED;
 
 /*
  * used to wait on when there are no free requests
@@ -44,12 +66,17 @@ struct blk_dev_struct blk_dev[NR_BLK_DEV] = {
 
 static inline void lock_buffer(struct buffer_head * bh)
 {
-	cli(); // 关掉的是这个进程的中断，而不是整个计算机的中断
+	unsigned long flags;
+
+	spin_lock_irqsave(&blk_lock,flags); // 关掉的是这个 CPU 的中断，其它 CPU 靠锁挡住
 	// NOTE lyq: 这里是 while，思考为什么不是 if? 可能时间很短，硬盘数据还没有读到缓冲区，又切换进程了；另一方面，不止一个在等待硬盘到缓冲区的读取，所以一次 sleep_on 不一定能把事情做完。
-	while (bh->b_lock)
+	while (bh->b_lock) {
+		spin_unlock(&blk_lock);	/* interrupts stay off */
 		sleep_on(&bh->b_wait); // b_wait 是指 buffer 等待进程队列；【等待所有共享这个 buffer 的进程】
+		spin_lock(&blk_lock);
+	}
 	bh->b_lock=1;
-	sti(); // 防止硬件中断，如时钟中断
+	spin_unlock_irqrestore(&blk_lock,flags); // 防止硬件中断，如时钟中断
 }
 
 static inline void unlock_buffer(struct buffer_head * bh)
@@ -60,6 +87,51 @@ static inline void unlock_buffer(struct buffer_head * bh)
 	wake_up(&bh->b_wait);
 }
 
+/*
+ * Get a request for 'dev', unless there are already 'max' out. NULL
+ * means wait on wait_for_request: that is also what we do when there is
+ * no memory for a new one, as there are requests out then (the cache
+ * keeps its last slab, so only the first ones can't be had at all).
+ */
+static struct request * get_request(int dev, int max)
+{
+	struct request * req;
+	unsigned long flags;
+
+	spin_lock_irqsave(&blk_lock,flags);
+	if (nr_requests >= max) {
+		spin_unlock_irqrestore(&blk_lock,flags);
+		return NULL;
+	}
+	nr_requests++;
+	spin_unlock_irqrestore(&blk_lock,flags);
+	if (!(req = (struct request *) kmem_cache_alloc(&request_cache))) {
+		spin_lock_irqsave(&blk_lock,flags);
+		nr_requests--;
+		spin_unlock_irqrestore(&blk_lock,flags);
+		return NULL;
+	}
+	req->dev = dev;
+	return req;
+}
+
+/*
+ * Called from end_request(), with the request off the device's list.
+ */
+void free_request(struct request * req)
+{
+	unsigned long flags;
+
+	req->dev = -1;
+	if (req != &swap_request) {
+		kmem_cache_free(&request_cache,req);
+		spin_lock_irqsave(&blk_lock,flags);
+		nr_requests--;
+		spin_unlock_irqrestore(&blk_lock,flags);
+	}
+	wake_up(&wait_for_request);
+}
+
 /*
  * add-request adds a request to the linked list.
  * It disables interrupts so that it can muck with the
@@ -68,14 +140,15 @@ static inline void unlock_buffer(struct buffer_head * bh)
 static void add_request(struct blk_dev_struct * dev, struct request * req)
 {
 	struct request * tmp;
+	unsigned long flags;
 
 	req->next = NULL;
-	cli(); // 原子操作，防止写读竞争【防止硬件中断】
+	spin_lock_irqsave(&blk_lock,flags); // 原子操作，防止写读竞争【防止硬件中断和其它 CPU】
 	if (req->bh)
 		req->bh->b_dirt = 0; // 清脏位，说明 dirty=0 & lock=1，说明这个 request 至少上路了 --> FIXME lyq: 不写回这个 dirty 的 block 吗？
 	if (!(tmp = dev->current_request)) { // 如果 current_request 是 NULL，全0 --> kernel/blk_drv/blk.h blk_dev[NR_BLK_DEV] 初始化为 NULL
 		dev->current_request = req;
-		sti();
+		spin_unlock_irqrestore(&blk_lock,flags);
 		(dev->request_fn)(); // 调用硬盘请求项处理函数，这里是 do_hd_request() 去给硬盘发送读盘命令
 		return;
 	}
@@ -86,7 +159,7 @@ static void add_request(struct blk_dev_struct * dev, struct request * req)
 			break;
 	req->next=tmp->next;
 	tmp->next=req;
-	sti();
+	spin_unlock_irqrestore(&blk_lock,flags);
 }
 
 static void make_request(int major,int rw, struct buffer_head * bh)
@@ -114,19 +187,18 @@ static void make_request(int major,int rw, struct buffer_head * bh)
 	}
 repeat:
 /* we don't allow the write-requests to fill up the queue completely:
- * we want some room for reads: they take precedence (n. 领先优先). The last third
- * of the requests are only for reads.
+ * we want some room for reads: they take precedence (n. 领先优先). Writes
+ * wait once 2/3 of NR_REQUEST are out, read-aheads are dropped at
+ * NR_REQUEST, and reads only wait if there is no memory.
  */
-	if (rw == READ)
-		req = request+NR_REQUEST; // 读从尾端开始，2/3 - 1 都是读
+	if (rw_ahead)
+		req = get_request(bh->b_dev,NR_REQUEST);
+	else if (rw == READ)
+		req = get_request(bh->b_dev,0x7fffffff); // 读不限量
 	else
-		req = request+((NR_REQUEST*2)/3); // 写从 2/3 处开始， 0-2/3 写和读
-/* find an empty request */
-	while (--req >= request) // 从后向前搜索空闲请求项，在 blk_dev_init 中，dev 初始化为-1，即空闲
-		if (req->dev<0) // 找到空闲请求项 kernel/blk_drv/blk.h line 27: -1 没有 request
-			break;
+		req = get_request(bh->b_dev,(NR_REQUEST*2)/3); // 写最多占 2/3
 /* if none found, sleep on new requests: check for rw_ahead */
-	if (req < request) {
+	if (!req) {
 		if (rw_ahead) { // 预读写 -> 就直接不管了
 			unlock_buffer(bh);
 			return;
@@ -135,7 +207,6 @@ repeat:
 		goto repeat;
 	}
 /* fill up the request-info, and add it to the queue --> 直接就在 32 个请求项数组中做的，因为之前赋值了 req = request+NR_REQUEST... */
-	req->dev = bh->b_dev; // 设置 dev
 	req->cmd = rw;
 	req->errors=0;
 	req->sector = bh->b_blocknr<<1;
@@ -147,6 +218,44 @@ repeat:
 	add_request(major+blk_dev,req); // 加载请求项，blk_dev 是那个数组，blk_dev+major 刚好是 hd 那项
 }
 
+/*
+ * ll_rw_page() reads or writes a whole page (8 sectors) at page number
+ * 'page' of the device, without going through the buffer cache: this is
+ * what the 'waiting' field of the request is for. The caller sleeps
+ * until the request is done. Writes are swap-outs, and use swap_request.
+ */
+void ll_rw_page(int rw, int dev, int page, char * buffer)
+{
+	struct request * req;
+	unsigned int major = MAJOR(dev);
+
+	if (major >= NR_BLK_DEV || !(blk_dev[major].request_fn)) {
+		printk("Trying to read nonexistent block-device\n\r");
+		return;
+	}
+	if (rw!=READ && rw!=WRITE)
+		panic("Bad block dev command, must be R/W");
+	if (rw == WRITE) {
+		while (swap_request.dev >= 0)
+			sleep_on(&wait_for_request);
+		req = &swap_request;
+		req->dev = dev;
+	} else while (!(req = get_request(dev,0x7fffffff)))
+		sleep_on(&wait_for_request);
+/* fill up the request-info, and add it to the queue */
+	req->cmd = rw;
+	req->errors = 0;
+	req->sector = page<<3;
+	req->nr_sectors = 8;
+	req->buffer = buffer;
+	req->waiting = current;
+	req->bh = NULL;
+	req->next = NULL;
+	current->state = TASK_UNINTERRUPTIBLE;	/* end_request() wakes us */
+	add_request(major+blk_dev,req);
+	schedule();
+}
+
 void ll_rw_block(int rw, struct buffer_head * bh) // 底层（low level）块设备操作
 {
 	unsigned int major;
@@ -158,13 +267,3 @@ void ll_rw_block(int rw, struct buffer_head * bh) // 底层（low level）块设
 	}
 	make_request(major,rw,bh);
 }
-
-void blk_dev_init(void)
-{
-	int i;
-
-	for (i=0 ; i<NR_REQUEST ; i++) {
-		request[i].dev = -1; // 初始化，全部 no request
-		request[i].next = NULL;
-	}
-}
@@ -237,7 +237,7 @@ int tty_read(unsigned channel, char * buf, int nr)
 	if (channel>2 || nr<0) return -1;
 	tty = &tty_table[channel];
 	oldalarm = current->alarm;
-	time = 10L*tty->termios.c_cc[VTIME];
+	time = (tty->termios.c_cc[VTIME]*HZ+9)/10;	/* VTIME is in 1/10 s */
 	minimum = tty->termios.c_cc[VMIN];
 	if (time && !minimum) {
 		minimum=1;
@@ -25,6 +25,7 @@ void release(struct task_struct * p)
 	for (i=1 ; i<NR_TASKS ; i++)
 		if (task[i]==p) {
 			task[i]=NULL;
+			free_page_dir(p);
 			free_page((long)p);
 			schedule();
 			return;
@@ -103,9 +104,14 @@ int do_exit(long code)
 {
 	int i;
 
-	// 1. 释放进程代码段和数据段的页面
-	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
-	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+	// 1. 释放进程代码段和数据段的页面（vfork 的子进程只是把借来的还回去）
+	exit_mmap();
+	if (current->vfork_parent)
+		vfork_release((unsigned long) pg_dir);
+	else {
+		free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
+		free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+	}
 	// 2. 儿子过继
 	for (i=0 ; i<NR_TASKS ; i++)
 		if (task[i] && task[i]->father == current->pid) {
@@ -123,6 +129,7 @@ int do_exit(long code)
 	current->pwd=NULL;
 	iput(current->root);
 	current->root=NULL;
+	del_mapping(current);
 	iput(current->executable);
 	current->executable=NULL;
 	// 5. 终端 tyy 关闭，清空使用过的协处理器
@@ -6,7 +6,7 @@
 
 /*
  *  'fork.c' contains the help-routines for the 'fork' system call
- * (see also system_call.s), and some misc functions ('verify_area').
+ * (see also system_call.S), and some misc functions ('verify_area').
  * Fork is rather simple, once you get the hang of it, but the memory
  * management can be a bitch. See 'mm/mm.c': 'copy_page_tables()'
  */
@@ -18,6 +18,8 @@
 #include <asm/system.h>
 
 extern void write_verify(unsigned long address);
+extern void ret_from_fork(void);
+int find_empty_process(void);
 
 long last_pid=0; // 存放系统开机以来累计进程数，也将其用作最新进程号，其值由 get_empty_process()生成。
 
@@ -49,18 +51,37 @@ int copy_mem(int nr,struct task_struct * p)
 		panic("We don't support separate I&D");
 	if (data_limit < code_limit)
 		panic("Bad data_limit");
-	new_data_base = new_code_base = nr * 0x4000000; // 0b100 * 2^24 Byte = 0b1000000 * 2^20 = 64 MB；因为虚拟内存共4GB，64个进程，每个进程64MB；进程i对应i*64MB。
+	new_data_base = new_code_base = TASK_BASE; // 每个进程都有自己的页目录，所以线性基址都一样
 	p->start_code = new_code_base;
 	set_base(p->ldt[1],new_code_base);
 	set_base(p->ldt[2],new_data_base);
-	// 为进程1创建第一个页表，并复制进程0的页表，并设置进程1的页目录项
-	if (copy_page_tables(old_data_base,new_data_base,data_limit)) {
-		free_page_tables(new_data_base,data_limit);
+	if (p->vfork_parent) {		/* vfork: borrow ours, nothing to copy */
+		p->tss.cr3 = current->tss.cr3;
+		return 0;
+	}
+	if (!(p->tss.cr3 = new_page_dir())) // 子进程的页目录，内核部分和 pg_dir 一样
+		return -ENOMEM;
+	// 复制父进程的页表，并设置子进程的页目录项
+	if (copy_page_tables(old_data_base,new_data_base,data_limit,p)) {
+		free_page_dir(p);
 		return -ENOMEM;
 	}
 	return 0;
 }
 
+/*
+ * A vfork() child gives the parent's address space back when it execs
+ * (to a new page directory 'dir') or exits (to pg_dir), and lets the
+ * parent run again.
+ */
+void vfork_release(unsigned long dir)
+{
+	current->tss.cr3 = dir;
+	__asm__("movl %%eax,%%cr3"::"a" (dir));
+	wake_up(&current->vfork_parent->vfork_wait);
+	current->vfork_parent = NULL;
+}
+
 /*
  *  Ok, this is the main fork-routine. It copies the system process
  * information (task[nr]) and sets up the necessary registers. It
@@ -69,8 +90,9 @@ int copy_mem(int nr,struct task_struct * p)
 // NOTE lyq: 核心代码+1! 所有进程创建都是 copy_process
 // 参数右序进栈
 int copy_process(
-		// _sys_fork 调用__copy_process前的压栈，nr 是eax中的值，此时已经被复制为分配的pid的值，即1
-		int nr,long ebp,long edi,long esi,long gs,
+		// _sys_fork 调用__copy_process前的压栈
+		// vfork 是 _sys_fork(0) / _sys_vfork(1) 最后压的
+		int vfork,long ebp,long edi,long esi,long gs,
 		// _system_call 调用__sys_fork前的压栈, 其中 long none 表示 call _sys_call_table(,%eax,4)，供 iret 返回确定位置
 		long none,long ebx,long ecx,long edx, long fs,long es,long ds,
 		// int $0x80 中断压栈
@@ -78,8 +100,9 @@ int copy_process(
 {
 	// 新进程的值
 	struct task_struct *p;
-	int i;
+	int i, nr;
 	struct file *f;
+	long * stack;
 
 	// 获得一个空闲页，账本 mem_map -> 用于分配内存（如空闲页、共享页）
 	// 强制类型转换，即把这个页当作 task_union (即[task_struct  page]) 使用
@@ -87,13 +110,22 @@ int copy_process(
 	p = (struct task_struct *) get_free_page();
 	if (!p) // 结果检测
 		return -EAGAIN;
-	task[nr] = p;
+/*
+ * get_free_page() may sleep, so the slot and pid are only picked now,
+ * and task[nr] is taken before anything else can sleep: otherwise two
+ * forks could be given the same slot.
+ */
+	if ((nr = find_empty_process()) < 0) {
+		free_page((long) p);
+		return nr;
+	}
 	// 复制进程 0 的 task_struct 内容，此时 ldt & tss 也一样，为后面的 copy on write 做了准备 -> 开始的时候共享，当子进程write的时候，才开始加载
 	*p = *current;	/* NOTE! this doesn't copy the supervisor stack，重要！！注意指针类型，仅复制task_struct内容，不复制stack */
 	
 	// 进程自定义设置
 	p->state = TASK_UNINTERRUPTIBLE; // 只有内核代码中明确表示将该进程设置为就绪状态才能被唤醒; 除此之外，没有任何办法将其唤醒
 	p->pid = last_pid;
+	task[nr] = p;
 	p->father = current->pid;
 	p->counter = p->priority;       // 避免进程0复制过来的 counter 用完了
 	p->signal = 0;
@@ -101,28 +133,40 @@ int copy_process(
 	p->leader = 0;		/* process leadership doesn't inherit */
 	p->utime = p->stime = 0; // 初始化用户态时间和核心态时间。
 	p->cutime = p->cstime = 0; // 初始化子进程用户态和核心态时间
+	p->lock_depth = 1;	/* ret_from_fork gives the kernel lock back */
 	p->start_time = jiffies;
-	p->tss.back_link = 0;
+	p->vfork_parent = vfork ? current : NULL;
+	p->vfork_wait = NULL;
+	p->min_flt = p->maj_flt = p->cow_flt = 0;
 	p->tss.esp0 = PAGE_SIZE + (long) p;//esp0是内核栈指针，p为task_union左内边缘，PAGE_SIZE + (long) p 为task_union的右外边缘
 	p->tss.ss0 = 0x10; //0x10就是10000，0特权级，GDT，数据段 --> ss0:esp0 用于作为程序在内核态执行时的堆栈。
-	p->tss.eip = eip; //重要！就是参数的EIP，是int 0x80压栈的，指向的是 include/unistd.h 中 int 0x80 的下一行：if(__res >= 0)
-	p->tss.eflags = eflags;
-	p->tss.eax = 0;   //重要！设置为常数0，决定main()函数中if (!fork())后面的分支走向 --> 所有的父进程创建子进程都是这样，到时候int 0x80 返回的值为0，然后进入到 init 中，即是说每个进程创建后，第一次被调用时，都会进入 init 执行
-	p->tss.ecx = ecx;
-	p->tss.edx = edx;
-	p->tss.ebx = ebx;
-	p->tss.esp = esp; //重要！新进程完全复制了父进程的堆栈内容。因此要求 task0 的堆栈比较“干净”。
-	p->tss.ebp = ebp;
-	p->tss.esi = esi;
-	p->tss.edi = edi;
-	p->tss.es = es & 0xffff; // 段寄存器仅 16 位有效。
-	p->tss.cs = cs & 0xffff;
-	p->tss.ss = ss & 0xffff;
-	p->tss.ds = ds & 0xffff;
-	p->tss.fs = fs & 0xffff;
-	p->tss.gs = gs & 0xffff;
-	p->tss.ldt = _LDT(nr); // 设置新任务的局部描述符表的选择符（LDT 描述符在 GDT 中）。
-	p->tss.trace_bitmap = 0x80000000;
+	p->tss.ldt = _LDT(0); // 局部描述符表的选择符（GDT 中只有一个 LDT 描述符，切换时改写）。
+/*
+ * The child starts out on its own kernel stack, which is made to look
+ * like the parent's was at ret_from_sys_call (with eax = 0, so that
+ * fork() returns 0 in the child), plus the registers that the system
+ * call entry didn't save. switch_to() jumps to ret_from_fork with esp
+ * pointing at them.
+ */
+	stack = (long *) (PAGE_SIZE + (long) p);
+	*--stack = ss & 0xffff;	// int $0x80 压栈部分，iret 回到用户态
+	*--stack = esp;		//重要！新进程完全复制了父进程的堆栈内容。因此要求 task0 的堆栈比较“干净”。
+	*--stack = eflags;
+	*--stack = cs & 0xffff;
+	*--stack = eip;		//重要！指向的是 include/unistd.h 中 int 0x80 的下一行：if(__res >= 0)
+	*--stack = ds & 0xffff;	// _system_call 压栈部分，段寄存器仅 16 位有效。
+	*--stack = es & 0xffff;
+	*--stack = fs & 0xffff;
+	*--stack = edx;
+	*--stack = ecx;
+	*--stack = ebx;
+	*--stack = 0;		//重要！eax 设置为常数0，决定main()函数中if (!fork())后面的分支走向
+	*--stack = gs & 0xffff;	// ret_from_fork 弹出部分
+	*--stack = esi;
+	*--stack = edi;
+	*--stack = ebp;
+	p->tss.esp = (long) stack;
+	p->tss.eip = (long) ret_from_fork;
 	if (last_task_used_math == current)
 		__asm__("clts ; fnsave %0"::"m" (p->tss.i387));
 	if (copy_mem(nr,p)) { // 设置子进程的代码段、数据段并创建、复制子进程的第一个页表。
@@ -137,13 +181,22 @@ int copy_process(
 		current->pwd->i_count++;    // 指向当前进程的指针
 	if (current->root) // 根目录i节点结构
 		current->root->i_count++;
-	if (current->executable) // 执行文件i节点结构
+	if (current->executable) { // 执行文件i节点结构
 		current->executable->i_count++;
-	// 每次新建进程，都会设置 tss & ldt，进程 0 的在 sched_init 中进行初始化
-	set_tss_desc(gdt+(nr<<1)+FIRST_TSS_ENTRY,&(p->tss));
-	set_ldt_desc(gdt+(nr<<1)+FIRST_LDT_ENTRY,&(p->ldt));
+		add_mapping(p);
+	}
+	for (i=0 ; i<NR_MMAP ; i++)	// mmap() 的文件也一样，页面已经由 copy_mem 处理
+		if (p->mmap[i].inode)
+			p->mmap[i].inode->i_count++;
     p->state = TASK_RUNNING;	/* do this last, just in case, 进程1处于就绪态->可以参与进程调度啦 */
-	return last_pid;    // 1，在下面的 find_empty_process 中进行设置, 这里表示活干完了，可以开始 run proc 1 了
+	/*
+	 * vfork: we can't touch our memory while the child is using it.
+	 * It's our child, so it can't be released before we wait for it.
+	 */
+	if (vfork)
+		while (p->vfork_parent)
+			sleep_on(&current->vfork_wait);
+	return p->pid;    // 不是 last_pid：copy_mem() 可能睡眠过，last_pid 早已被别的 fork 改了
 }
 
 int find_empty_process(void)
@@ -165,3 +218,42 @@ int find_empty_process(void)
 			return i;       // 表示这个空位可以放置进程
 	return -EAGAIN;
 }
+
+/*
+ * A kernel thread is a task that never leaves kernel mode. It is a copy
+ * of task 0 in the swapper's page directory, and it starts out in fn()
+ * with an empty kernel stack: switch_to() just jumps there. fn() must
+ * never return.
+ */
+int kernel_thread(void (*fn)(void))
+{
+	struct task_struct * p;
+	int nr;
+
+	if (!(p = (struct task_struct *) get_free_page()))
+		return -EAGAIN;
+	if ((nr = find_empty_process()) < 0) {	/* see copy_process() */
+		free_page((long) p);
+		return nr;
+	}
+	*p = *task[0];
+	p->state = TASK_UNINTERRUPTIBLE;
+	p->pid = last_pid;
+	p->father = 0;
+	p->counter = p->priority;
+	p->signal = 0;
+	p->alarm = 0;
+	p->leader = 0;
+	p->utime = p->stime = 0;
+	p->cutime = p->cstime = 0;
+	p->start_time = jiffies;
+	p->min_flt = p->maj_flt = p->cow_flt = 0;
+	p->tss.cr3 = (unsigned long) pg_dir;
+	p->tss.esp0 = PAGE_SIZE + (long) p;
+	p->tss.esp = PAGE_SIZE + (long) p;
+	p->tss.eip = (long) fn;
+	p->lock_depth = 1;	/* it never leaves the kernel */
+	task[nr] = p;
+	p->state = TASK_RUNNING;
+	return p->pid;
+}
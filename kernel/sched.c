@@ -15,10 +15,13 @@
 #include <linux/sys.h>
 #include <linux/fdreg.h>
 #include <asm/system.h>
+#include <asm/spinlock.h>
 #include <asm/io.h>
 #include <asm/segment.h>
 
 #include <signal.h>
+#include <unistd.h>
+#include <errno.h>
 
 #define _S(nr) (1<<((nr)-1))
 #define _BLOCKABLE (~(_S(SIGKILL) | _S(SIGSTOP)))
@@ -27,13 +30,16 @@ void show_task(int nr,struct task_struct * p)
 {
 	int i,j = 4096-sizeof(struct task_struct);
 
-	printk("%d: pid=%d, state=%d, ",nr,p->pid,p->state);
+	printk("%d: pid=%d, state=%d, rss=%d, flt=%d/%d/%d, ",nr,p->pid,
+		p->state,task_rss(p),p->min_flt,p->maj_flt,p->cow_flt);
 	i=0;
 	while (i<j && !((char *)(p+1))[i])
 		i++;
 	printk("%d (of %d) chars free in kernel stack\n\r",i,j);
 }
 
+static void show_latency(void);
+
 void show_stat(void)
 {
 	int i;
@@ -41,10 +47,10 @@ void show_stat(void)
 	for (i=0;i<NR_TASKS;i++)
 		if (task[i])
 			show_task(i,task[i]);
+	show_latency();
+	malloc_stats();
 }
 
-#define LATCH (1193180/HZ)
-
 extern void mem_use(void);
 
 extern int timer_interrupt(void);
@@ -59,14 +65,27 @@ union task_union {
 // NOTE lyq:静态全局变量，static 赋予内部链接，即其只能在定义它的源文件中访问
 static union task_union init_task = {INIT_TASK,};
 
-long volatile jiffies=0; // 从开机开始算起的滴答数（10ms/滴答）
+long volatile jiffies=0; // 从开机开始算起的滴答数（1/HZ 秒/滴答）
 long startup_time=0;
 // 所以 *current 指的进程0的task_struct
+#ifdef CONFIG_SMP
+struct task_struct *current_set[NR_CPUS] = {&(init_task.task), };
+struct task_struct *idle_set[NR_CPUS] = {&(init_task.task), };
+struct task_struct *last_math_set[NR_CPUS] = {NULL, };
+#else
 struct task_struct *current = &(init_task.task);
 struct task_struct *last_task_used_math = NULL;
+#endif
 
 struct task_struct * task[NR_TASKS] = {&(init_task.task), };
 
+/*
+ * One TSS per cpu. Tasks are switched in software, so all the cpu needs
+ * it for is ss0:esp0, which switch_to() points at the next task's kernel
+ * stack, and the io-bitmap offset (none: 0x8000 is past the limit).
+ */
+struct tss_struct init_tss[NR_CPUS];
+
 // 进程 0 的用户栈
 long user_stack [ PAGE_SIZE>>2 ] ;
 
@@ -95,6 +114,165 @@ void math_state_restore()
 	}
 }
 
+/*
+ * Set when current should give up the cpu as soon as it safely can:
+ * its time slice ran out while it was in the kernel, or a real-time
+ * task was woken. ret_from_sys_call checks it on the way back to user
+ * mode, and long kernel loops check it with cond_resched().
+ */
+#ifdef CONFIG_SMP
+int need_resched_set[NR_CPUS] = {0, };
+#else
+int need_resched = 0;
+#endif
+
+/*
+ * Each cpu has a run queue of its own: the tasks whose 'processor' is
+ * that cpu. A task stays on its queue when it sleeps and is woken up,
+ * so it tends to find its cache still warm, and schedule() only picks
+ * from its own queue. A task that is running is always on the queue of
+ * the cpu it runs on, so no two cpus can pick the same one.
+ */
+#ifdef CONFIG_SMP
+#define cpu_curr(cpu) (current_set[cpu])
+#define on_runqueue(p,cpu) ((p)->processor == (cpu))
+#else
+#define cpu_curr(cpu) current
+#define on_runqueue(p,cpu) ((void)(cpu),1)
+#endif
+#define task_running(p) (cpu_curr((p)->processor) == (p))
+
+#ifdef CONFIG_SMP
+/* make 'cpu' call schedule() soon: another cpu is sent an IPI for it */
+static void resched_cpu(int cpu)
+{
+	need_resched_set[cpu] = 1;
+	if (cpu != smp_processor_id())
+		smp_send_reschedule(cpu);
+}
+
+/*
+ * A task was woken on 'cpu'. If that cpu is idle it has to be told;
+ * if it's busy, an idle cpu (if any) is told instead, which will pull
+ * the task over in load_balance().
+ */
+static void kick_idle(int cpu)
+{
+	int i;
+
+	if (cpu_curr(cpu) != idle_task(cpu)) {
+		for (i = 0 ; i < smp_num_cpus ; i++)
+			if (cpu_curr(i) == idle_task(i))
+				break;
+		if (i >= smp_num_cpus)
+			return;
+		cpu = i;
+	}
+	resched_cpu(cpu);
+}
+
+/*
+ * Called by schedule() before it picks. If the busiest queue with a
+ * task waiting on it (runnable, but not running) has at least two more
+ * runnable tasks than ours, or ours has none, the best of its waiting
+ * tasks moves over to ours. One at a time is enough: every schedule()
+ * on every cpu gets another go.
+ */
+static void load_balance(int cpu)
+{
+	int nr[NR_CPUS], waiting[NR_CPUS];
+	struct task_struct ** p, * pick = NULL;
+	int i, src = -1;
+
+	for (i = 0 ; i < smp_num_cpus ; i++)
+		nr[i] = waiting[i] = 0;
+	for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
+		if (*p && (*p)->state == TASK_RUNNING) {
+			nr[(*p)->processor]++;
+			if (!task_running(*p))
+				waiting[(*p)->processor]++;
+		}
+	for (i = 0 ; i < smp_num_cpus ; i++)
+		if (i != cpu && waiting[i] && (src < 0 || nr[i] > nr[src]))
+			src = i;
+	if (src < 0 || (nr[cpu] && nr[src] - nr[cpu] < 2))
+		return;
+	for(p = &LAST_TASK ; p > &FIRST_TASK ; --p) {
+		if (!*p || (*p)->processor != src ||
+		    (*p)->state != TASK_RUNNING || task_running(*p))
+			continue;
+		if (!pick || (*p)->rt_priority > pick->rt_priority ||
+		    ((*p)->rt_priority == pick->rt_priority &&
+		     (*p)->counter > pick->counter))
+			pick = *p;
+	}
+	pick->processor = cpu;
+}
+#else
+#define resched_cpu(cpu) (need_resched = 1)
+#endif
+
+/*
+ * Scheduling latency, from a task being woken up to it getting the cpu,
+ * as a histogram: bucket i counts delays of [2^i,2^(i+1)) microseconds.
+ * Time is read from the 8253, which counts down LATCH-1..0 once per tick
+ * (mode 2), so it's good to a microsecond. It wraps after an hour, which
+ * doesn't matter for differences.
+ */
+#define LAT_BUCKETS 16
+
+static unsigned long lat_hist[LAT_BUCKETS] = {0,};
+static unsigned long lat_max = 0;
+
+static unsigned long clock_now(void)
+{
+	unsigned long flags, count, now;
+
+	save_flags_cli(flags);
+	outb_p(0x00,0x43);		/* latch the count of ch 0 */
+	count = inb_p(0x40);
+	count |= inb_p(0x40) << 8;
+	if (count >= LATCH)		/* idle one-shot: it's behind anyway */
+		count = LATCH-1;
+	now = jiffies*LATCH + (LATCH-1-count);
+	restore_flags(flags);
+	return now ? now : 1;
+}
+
+static void latency_account(struct task_struct * p)
+{
+	unsigned long us;
+	int i;
+
+	if (!p->wake_stamp)
+		return;
+	us = clock_now() - p->wake_stamp;
+	p->wake_stamp = 0;
+	if (us > 0x7fffffff)		/* tick not counted yet when woken */
+		us = 0;
+	else if (us > 1193180)
+		us = 1000000;
+	else
+		us = us * 838 / 1000;	/* 1193180 Hz */
+	if (us > lat_max)
+		lat_max = us;
+	for (i = 0 ; i < LAT_BUCKETS-1 && us >= (2UL << i) ; i++)
+		/* nothing */ ;
+	lat_hist[i]++;
+}
+
+static void show_latency(void)
+{
+	int i;
+
+	printk("wakeup latency (us):");
+	for (i = 0 ; i < LAT_BUCKETS ; i++)
+		if (lat_hist[i])
+			printk(i < LAT_BUCKETS-1 ? " <%d:%d" : " >=%d:%d",
+				i < LAT_BUCKETS-1 ? 2<<i : 1<<i,lat_hist[i]);
+	printk(" max %d\n\r",lat_max);
+}
+
 /*
  *  'schedule()' is the scheduler function. This is GOOD CODE! There
  * probably won't be any reason to change this, as it should work well
@@ -104,53 +282,134 @@ void math_state_restore()
  *   NOTE!!  Task 0 is the 'idle' task, which gets called when no other
  * tasks can run. It can not be killed, and it cannot sleep. The 'state'
  * information in task[0] is never used.
+ * The other cpus have idle tasks of their own, which aren't in task[]:
+ * idle_task(cpu).
  *   NOTE lyq: 进程调度，启动！
  */
 void schedule(void)
 {
 	int i,next,c;
+	int cpu = smp_processor_id();
     struct task_struct ** p;    // 指向指针的指针
 
+	need_resched = 0;
 /* check alarm, wake up any interruptible tasks that have got a signal */
 
 	for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
 		if (*p) {
-			if ((*p)->alarm && (*p)->alarm < jiffies) { // 设置了定时且定时已过
+			if ((*p)->alarm && (*p)->alarm <= jiffies) { // 设置了定时且定时已过
 					(*p)->signal |= (1<<(SIGALRM-1)); // 设置信号量
-					(*p)->alarm = 0; // 关闭警报
+					(*p)->alarm = (*p)->alarm_interval ?
+						jiffies+(*p)->alarm_interval : 0; // 关闭警报，ualarm 则重新装载
 				}
 			if (((*p)->signal & ~(_BLOCKABLE & (*p)->blocked)) &&
-			(*p)->state==TASK_INTERRUPTIBLE) // 信号量中除被阻塞的信号外还有其它信号，且进程处于可中断状态
+			(*p)->state==TASK_INTERRUPTIBLE) { // 信号量中除被阻塞的信号外还有其它信号，且进程处于可中断状态
 				(*p)->state=TASK_RUNNING; // 设置就绪态 --> 先处理 signal 的事情
+				(*p)->wake_stamp = clock_now();
+#ifdef CONFIG_SMP
+				if ((*p)->processor != cpu)
+					kick_idle((*p)->processor);
+#endif
+			}
 		}
 
+#ifdef CONFIG_SMP
+	if (smp_num_cpus > 1)
+		load_balance(cpu);
+#endif
+
 /* this is the scheduler proper: */
 
+/*
+ * Real-time tasks (SCHED_FIFO/SCHED_RR) go first, highest rt_priority
+ * wins. Between equal priorities the larger counter wins, so a SCHED_RR
+ * task that used up its slice falls behind its peers until they have
+ * all run out, and then they are refilled together.
+ */
+	while (1) {
+		c = -1;
+		next = 0;
+		i = NR_TASKS;
+		p = &task[NR_TASKS];
+		while (--i) {
+			if (!*--p || (*p)->policy == SCHED_OTHER ||
+			    (*p)->state != TASK_RUNNING || !on_runqueue(*p,cpu))
+				continue;
+			if (!next || (*p)->rt_priority > task[next]->rt_priority ||
+			    ((*p)->rt_priority == task[next]->rt_priority &&
+			     (*p)->counter > c))
+				c = (*p)->counter, next = i;
+		}
+		if (!next)
+			break;
+		if (c) {
+			latency_account(task[next]);
+			switch_to(task[next]);
+			return;
+		}
+		for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
+			if (*p && (*p)->policy != SCHED_OTHER && on_runqueue(*p,cpu) &&
+			    (*p)->rt_priority == task[next]->rt_priority)
+				(*p)->counter = (*p)->priority;
+	}
+
 	while (1) {
 		c = -1;                 // c = 0xFFFFFFFF
 		next = 0;               // 指向下一个进程；默认进程0 【业界称进程0为怠速进程，我称其为劳模进程】
-		i = NR_TASKS;           // i = 64
+		i = NR_TASKS;
 		p = &task[NR_TASKS];
 		while (--i) {           // 高往低遍历；找就绪态，时间片最多的
-			if (!*--p)
+			if (!*--p || !on_runqueue(*p,cpu))
 				continue;
 			if ((*p)->state == TASK_RUNNING && (*p)->counter > c)
-				c = (*p)->counter, next = i;
+				c = (*p)->counter, next = i; // 走到这里说明没有就绪的实时进程
 		}
 		if (c) break;           // 注意 c 为 counter；如果一个都没找到，c 还是 -1，next 为 0，break 切换到0
 		// 若找到的时间片为0，则重置所有进程的时间片，继续找
 		for(p = &LAST_TASK ; p > &FIRST_TASK ; --p) // 高往低遍历
-			if (*p)             // 优先级设置：该系统不单列优先级，折成时间片
+			if (*p && (*p)->policy == SCHED_OTHER) // 优先级设置：普通进程不单列优先级，折成时间片
 				(*p)->counter = ((*p)->counter >> 1) +
 						(*p)->priority;
 	}
-	switch_to(next); // 找到进程后进行切换
+	if (!next) {			/* nothing: the idle task of this cpu */
+		switch_to(idle_task(cpu));
+		return;
+	}
+	latency_account(task[next]);
+	switch_to(task[next]); // 找到进程后进行切换
+}
+
+/*
+ * Called for every task that has just been made runnable. Starts its
+ * latency clock, and a real-time task preempts anything of lower
+ * priority on its cpu: zeroing that task's counter makes
+ * ret_from_sys_call (or the next timer tick) call schedule(). Anything
+ * else may get an idle cpu going.
+ */
+static inline void preempt_check(struct task_struct * p)
+{
+	struct task_struct * curr = cpu_curr(p->processor);
+
+	p->wake_stamp = clock_now();
+	if (p->policy != SCHED_OTHER && (curr->policy == SCHED_OTHER ||
+	    p->rt_priority > curr->rt_priority)) {
+		curr->counter = 0;
+		resched_cpu(p->processor);
+	}
+#ifdef CONFIG_SMP
+	else
+		kick_idle(p->processor);
+#endif
 }
 
+static void cpu_idle(void);
+
 int sys_pause(void)     // 做进程调度，目前是**current 进程的内核态**在跑
 {
 	current->state = TASK_INTERRUPTIBLE;    // 目前可能是进程 0（如果创建进程1的时候，进程0没有state/counter，就会被调度走）
 	schedule();
+	if (current == &(init_task.task))
+		cpu_idle();
 	return 0;
 }
 
@@ -169,8 +428,10 @@ void sleep_on(struct task_struct **p) // FIXME lyq: 为啥是从 task 数组角
 	*p = current; // p 指向当前需要 buffer 的进程
 	current->state = TASK_UNINTERRUPTIBLE; // 开始让 current 执行；进程1在这里被挂起；进程0在上面的 sys_pause 中被挂起 --> 【全部被挂起】
 	schedule();
-	if (tmp)
+	if (tmp) {
 		tmp->state=0; // 0 即 TASK_RUNNING
+		preempt_check(tmp);
+	}
 }
 
 void interruptible_sleep_on(struct task_struct **p)
@@ -187,17 +448,21 @@ repeat:	current->state = TASK_INTERRUPTIBLE;
 	schedule();
 	if (*p && *p != current) {
 		(**p).state=0;
+		preempt_check(*p);
 		goto repeat;
 	}
 	*p=NULL;
-	if (tmp)
+	if (tmp) {
 		tmp->state=0;
+		preempt_check(tmp);
+	}
 }
 
 void wake_up(struct task_struct **p)
 {
 	if (p && *p) { // p: 指向 b_wait 的指针；*p b_wait 的值；**p b_wait指向的task_struct
 		(**p).state=0; // 0 即 runnable，TASKRUNNING，改为就绪态
+		preempt_check(*p);
 		*p=NULL; // [按理说，应该是 *p=tmp; --> 显示用队列唤醒上一个]，[*p=NULL, 隐式唤醒，等待调度]
 	}
 }
@@ -219,7 +484,7 @@ int ticks_to_floppy_on(unsigned int nr)
 
 	if (nr>3)
 		panic("floppy_on: nr>3");
-	moff_timer[nr]=10000;		/* 100 s = very big :-) */
+	moff_timer[nr]=100*HZ;		/* 100 s = very big :-) */
 	cli();				/* use floppy_off to turn it off */
 	mask |= current_DOR;
 	if (!selected) {
@@ -311,39 +576,250 @@ void add_timer(long jiffies, void (*fn)(void))
 	sti();
 }
 
-void do_timer(long cpl)
+/*
+ * Expire 'ticks' ticks worth of timer_list. The list holds deltas, so
+ * whatever a timer overshot is carried into the next one.
+ */
+static void run_timers(long ticks)
 {
-	extern int beepcount;
-	extern void sysbeepstop(void);
-
-	if (beepcount)
-		if (!--beepcount)
-			sysbeepstop();
-
-	if (cpl)
-		current->utime++;
-	else
-		current->stime++;
-
 	if (next_timer) {
-		next_timer->jiffies--;
+		next_timer->jiffies -= ticks;
 		while (next_timer && next_timer->jiffies <= 0) {
 			void (*fn)(void);
-			
+			long left = next_timer->jiffies;
+
 			fn = next_timer->fn;
 			next_timer->fn = NULL;
 			next_timer = next_timer->next;
+			if (next_timer)
+				next_timer->jiffies += left;
 			(fn)();
 		}
 	}
-	if (current_DOR & 0xf0)
-		do_floppy_timer();
-	if ((--current->counter)>0) return; // 判断时间片是否消减为0
+}
+
+#ifdef TICKLESS_IDLE
+/*
+ * Tickless idle. When task 0 has nothing to do, it reprograms channel 0
+ * of the 8253 as a one-shot (mode 0) that fires when the next timer_list
+ * entry or alarm is due, instead of every 1/HZ. 'tick_stopped' is the
+ * number of ticks left until then, 0 while the tick is periodic.
+ *
+ * The counter is only 16 bits, so a single one-shot spans at most
+ * ONESHOT_TICKS (5 ticks at HZ=100, 54 at HZ=1000: 50-55ms). Longer
+ * idle periods are a chain of one-shots: do_timer() accounts each one
+ * and starts the next, and the idle task goes back to sleep without
+ * going through schedule(). So an idle period is only limited by the
+ * next event (MAX_IDLE_TICKS, an hour, if there is none), and costs one
+ * interrupt per 50ms or so instead of one per tick.
+ *
+ * Only with a single cpu running: the others could add timers and
+ * alarms meanwhile, so the tick stays periodic then.
+ */
+#define ONESHOT_TICKS (0xffff/LATCH)
+#define MAX_IDLE_TICKS (3600*HZ)
+
+static long tick_stopped = 0;
+static long oneshot_ticks = 0;		/* what the running one-shot covers */
+
+static void tick_periodic(void)
+{
+	outb_p(0x34,0x43);		/* binary, mode 2, LSB/MSB, ch 0 */
+	outb_p(LATCH & 0xff , 0x40);	/* LSB */
+	outb(LATCH >> 8 , 0x40);	/* MSB */
+}
+
+/* start the next one-shot of the chain, for up to tick_stopped ticks */
+static void tick_oneshot(void)
+{
+	long latch;
+
+	oneshot_ticks = tick_stopped < ONESHOT_TICKS ? tick_stopped : ONESHOT_TICKS;
+	latch = oneshot_ticks*LATCH;
+
+	outb_p(0x30,0x43);		/* binary, mode 0, LSB/MSB, ch 0 */
+	outb_p(latch & 0xff , 0x40);
+	outb(latch >> 8 , 0x40);
+}
+
+/*
+ * Number of ticks until something needs the timer interrupt: the head
+ * of timer_list (which holds deltas), the nearest alarm, or 0 if the
+ * floppy motor timers or the beeper want to be run every tick.
+ */
+static long next_event_ticks(void)
+{
+	extern int beepcount;
+	struct task_struct ** p;
+	long ticks = MAX_IDLE_TICKS;
+
+	if (beepcount || (current_DOR & 0xf0))
+		return 0;
+	if (next_timer && next_timer->jiffies < ticks)
+		ticks = next_timer->jiffies;
+	for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
+		if (*p && (*p)->alarm && (*p)->alarm - jiffies < ticks)
+			ticks = (*p)->alarm - jiffies;
+	return ticks;
+}
+
+/*
+ * Called with interrupts off when the idle task is woken by something
+ * other than the one-shot. Accounts the whole ticks that have passed
+ * and goes back to the periodic tick. If the one-shot has already run
+ * out (OUT high), its interrupt is pending and do_timer() accounts it.
+ */
+static void tick_restart(void)
+{
+	long left;
+
+	outb_p(0xc2,0x43);		/* read-back: status and count of ch 0 */
+	if (inb_p(0x40) & 0x80) {
+		inb_p(0x40);
+		inb_p(0x40);
+		tick_stopped = oneshot_ticks;	/* and that ends the chain */
+		return;
+	}
+	left = inb_p(0x40);
+	left |= inb_p(0x40) << 8;
+	left = (oneshot_ticks*LATCH - left)/LATCH;
+	tick_stopped = 0;
+	tick_periodic();
+	if (left > 0) {
+		jiffies += left;
+		run_timers(left);
+	}
+}
+#endif
+
+/* nothing on our queue, and nothing waiting on another one to pull over */
+static int nothing_to_run(void)
+{
+	struct task_struct ** p;
+	int cpu = smp_processor_id();
+
+	for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
+		if (*p && (*p)->state == TASK_RUNNING &&
+		    (on_runqueue(*p,cpu) || !task_running(*p)))
+			return 0;
+	return 1;
+}
+
+/*
+ * Halt until the next interrupt. On a multiprocessor the kernel lock is
+ * given up meanwhile, or no other cpu could get into the kernel.
+ */
+static inline void idle_halt(void)
+{
+	unlock_kernel();
+	__asm__("sti ; hlt");
+	cli();
+	lock_kernel();
+}
+
+/*
+ * cpu_idle() is what task 0 does when schedule() found nothing else
+ * to run: zero a few pages for get_free_page() while it's at it, then
+ * halt until the next interrupt. The check for runnable tasks
+ * is done with interrupts off, and "sti ; hlt" can't be interrupted in
+ * between, so a wake_up() from an interrupt can't get lost. One from
+ * another cpu comes with an IPI (kick_idle()), which does the same.
+ */
+static void cpu_idle(void)
+{
+	zero_idle_pages();
+	cli();
+	if (!nothing_to_run()) {
+		sti();
+		return;
+	}
+#ifdef TICKLESS_IDLE
+	if (smp_num_cpus == 1 && (tick_stopped = next_event_ticks()) > 1)
+		tick_oneshot();
+	else
+		tick_stopped = 0;
+	for (;;) {
+		idle_halt();
+		if (!tick_stopped)		/* the last one-shot ran out */
+			break;
+		if (!nothing_to_run()) {	/* woken by something else */
+			tick_restart();
+			break;
+		}
+	}
+	sti();
+#else
+	idle_halt();
+	sti();
+#endif
+}
+
+#ifdef CONFIG_SMP
+/* what the idle tasks of the other cpus do, see start_secondary() */
+void cpu_idle_loop(void)
+{
+	for (;;) {
+		schedule();
+		cpu_idle();
+	}
+}
+#endif
+
+/*
+ * Charge 'ticks' to whatever this cpu is running, and take them off its
+ * time slice.
+ */
+static void update_process_times(long ticks, long cpl)
+{
+	if (cpl)
+		current->utime += ticks;
+	else
+		current->stime += ticks;
+	if (current->policy == SCHED_FIFO) {	/* no time slice */
+		if (current->counter) return;	/* 0: preempt_check() wants a switch */
+	} else if ((current->counter -= ticks)>0) return; // 判断时间片是否消减为0
 	current->counter=0;
-	if (!cpl) return; // current privilege level 只有在3特权级下才能时钟中断切换，0特权级下不能切换
+	need_resched = 1;
+	if (!cpl) return; // current privilege level 内核态不直接切换，等 cond_resched() 或返回用户态时
 	schedule();
 }
 
+void do_timer(long cpl)
+{
+	extern int beepcount;
+	extern void sysbeepstop(void);
+	long ticks = 1;
+
+#ifdef TICKLESS_IDLE
+	if (tick_stopped) {		/* an idle one-shot ran out */
+		ticks = oneshot_ticks;
+		jiffies += ticks-1;	/* timer_interrupt did one of them */
+		if ((tick_stopped -= ticks) > 0)
+			tick_oneshot();		/* the chain goes on */
+		else {
+			tick_stopped = 0;
+			tick_periodic();
+		}
+	}
+#endif
+	if (beepcount)
+		if (!--beepcount)
+			sysbeepstop();
+
+	run_timers(ticks);
+	if (current_DOR & 0xf0)
+		do_floppy_timer();
+	update_process_times(ticks,cpl);
+}
+
+#ifdef CONFIG_SMP
+/* the local APIC timer of the other cpus: jiffies are the boot cpu's job */
+void do_local_timer(long cpl)
+{
+	update_process_times(1,cpl);
+}
+#endif
+
 int sys_alarm(long seconds)
 {
 	int old = current->alarm;
@@ -351,6 +827,29 @@ int sys_alarm(long seconds)
 	if (old)
 		old = (old - jiffies) / HZ;
 	current->alarm = (seconds>0)?(jiffies+HZ*seconds):0;
+	current->alarm_interval = 0;
+	return (old);
+}
+
+/*
+ * Microseconds are rounded up to whole ticks, so the resolution is what
+ * HZ was configured to. 'interval' re-arms the alarm after it has fired.
+ */
+#define USECS_TO_TICKS(us) ((us)/1000000*HZ + ((us)%1000000*HZ+999999)/1000000)
+
+int sys_ualarm(long usecs, long interval)
+{
+	long old = current->alarm;
+
+	if (old) {
+		old -= jiffies;
+		if (old/HZ >= 0x7fffffff/1000000)	/* too many usecs for a long */
+			old = 0x7fffffff;
+		else
+			old = (old/HZ)*1000000 + (old%HZ)*1000000/HZ;
+	}
+	current->alarm = (usecs>0)?(jiffies+USECS_TO_TICKS(usecs)):0;
+	current->alarm_interval = (usecs>0 && interval>0)?USECS_TO_TICKS(interval):0;
 	return (old);
 }
 
@@ -391,31 +890,63 @@ int sys_nice(long increment)
 	return 0;
 }
 
+int sys_sched_setscheduler(int pid, int policy, int rt_priority)
+{
+	struct task_struct ** p;
+
+	if (policy == SCHED_OTHER) {
+		if (rt_priority)
+			return -EINVAL;
+	} else if (policy == SCHED_FIFO || policy == SCHED_RR) {
+		if (rt_priority < 1 || rt_priority > SCHED_RT_MAX)
+			return -EINVAL;
+		if (!suser())
+			return -EPERM;
+	} else
+		return -EINVAL;
+	if (!pid)
+		pid = current->pid;
+	for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
+		if (*p && (*p)->pid == pid) {
+			if (current->euid != (*p)->euid && !suser())
+				return -EPERM;
+			(*p)->policy = policy;
+			(*p)->rt_priority = rt_priority;
+			current->counter = 0;	/* let schedule() sort it out */
+			return 0;
+		}
+	return -ESRCH;
+}
+
+/*
+ * Set up the TSS and LDT descriptor of 'cpu' for its idle task:
+ * sched_init() does the boot cpu, smp.c the others.
+ */
+void cpu_init_tss(int cpu, struct task_struct * idle)
+{
+	init_tss[cpu].esp0 = idle->tss.esp0;
+	init_tss[cpu].ss0 = 0x10;
+	init_tss[cpu].trace_bitmap = 0x80000000;
+	set_tss_desc(gdt+FIRST_TSS_ENTRY+2*cpu,init_tss+cpu);
+	set_ldt_desc(gdt+FIRST_LDT_ENTRY+2*cpu,&(idle->ldt));
+}
+
 void sched_init(void)
 {
 	int i;
-	struct desc_struct * p;
 
 	if (sizeof(struct sigaction) != 16)
 		// printk
 		panic("Struct sigaction MUST be 16 bytes");
-	// 设置第一个 TSS0（task state segment） 和 LDT0 ==> 和用户进程开始相关
-	set_tss_desc(gdt+FIRST_TSS_ENTRY,&(init_task.task.tss));
-	set_ldt_desc(gdt+FIRST_LDT_ENTRY,&(init_task.task.ldt));
-	p = gdt+2+FIRST_TSS_ENTRY; // TSS1
-	// LDT1\TSS1 之后的63个进程全部初始化
-	for(i=1;i<NR_TASKS;i++) {
+	// 设置 cpu 0 的 TSS（task state segment） 和 LDT0 ==> 和用户进程开始相关
+	cpu_init_tss(0,&(init_task.task));
+	for(i=1;i<NR_TASKS;i++)
 		task[i] = NULL;
-		p->a=p->b=0; // TSS 1..63
-		p++;
-		p->a=p->b=0; // LDT 1..63
-		p++;
-	}
 /* Clear NT, so that we won't have troubles with that later on */
 	__asm__("pushfl ; andl $0xffffbfff,(%esp) ; popfl");
-	ltr(0);		// 重要！将TSS挂接到TR寄存器   load task register，指向当前的 tss
+	ltr(0);		// 重要！将TSS挂接到TR寄存器   load task register，此后不再改变
 	lldt(0);	// 重要！将LDT挂接到LDTR寄存器 load ldt
-	outb_p(0x36,0x43);		/* binary, mode 3, LSB/MSB, ch 0 ==> 设置定时器 */
+	outb_p(0x34,0x43);		/* binary, mode 2, LSB/MSB, ch 0 ==> 设置定时器 */
 	outb_p(LATCH & 0xff , 0x40);	/* LSB => LATCH：每10ms一次始终中断 */
 	outb(LATCH >> 8 , 0x40);	/* MSB */
 	set_intr_gate(0x20,&timer_interrupt); //重要！设置时钟中断，进程调度的基础
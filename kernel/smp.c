@@ -0,0 +1,459 @@
+/*
+ *  linux/kernel/smp.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * smp.c starts up the other processors of an Intel MultiProcessor
+ * machine, and keeps them out of each other's way.
+ *
+ * The processors and APICs are found in the MP configuration table.
+ * Each application processor (AP) gets INIT and two startup IPIs, which
+ * start it in real mode at the trampoline (trampoline.S), and that takes
+ * it to start_secondary() on the stack of an idle task of its own. The
+ * device interrupts stay with the 8259, which is wired to the local
+ * APIC of the boot cpu (LINT0, "virtual wire"), so the IO APIC is only
+ * noted. What the local APICs are used for is a timer for each AP and
+ * IPIs to get another cpu to reschedule.
+ *
+ * The kernel itself is still run by one cpu at a time: there is one
+ * kernel lock, taken on every way in (system calls, faults, interrupts,
+ * see <asm/entry.h>) and given back on the way out, and by the idle
+ * task while it halts. So everything that was safe with cli/sti still
+ * is, and the other cpus run user code meanwhile. current->lock_depth
+ * counts how often the lock has been taken: it belongs to whatever task
+ * runs, so it's passed on through schedule(), and a new task starts
+ * with 1 (ret_from_fork gives it back).
+ */
+#include <stddef.h>
+#include <string.h>
+
+#include <linux/config.h>
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/head.h>
+#include <linux/mm.h>
+#include <linux/smp.h>
+#include <asm/system.h>
+#include <asm/io.h>
+#include <asm/spinlock.h>
+
+#ifdef CONFIG_SMP
+
+extern void cpu_init_tss(int cpu, struct task_struct * idle);
+extern void cpu_idle_loop(void);
+extern void do_local_timer(long cpl);
+
+extern int reschedule_interrupt(void);
+extern int apic_timer_interrupt(void);
+extern int spurious_interrupt(void);
+
+extern char trampoline[], trampoline_end[];
+
+int smp_num_cpus = 1;			/* the ones that are running */
+int cpu_apic_id[NR_CPUS] = {0,};
+unsigned long apic_addr = 0;		/* local APIC, physical */
+unsigned long io_apic_addr = 0;		/* first IO APIC, physical */
+
+static int mp_nr_cpus = 0;		/* what the MP table says */
+static int mp_apic_id[NR_CPUS];
+
+/* saved by setup.s: 0x40E is in the page directory by now */
+#define EBDA_SEG (*(unsigned short *)0x90014)
+
+/* MP floating pointer structure: "_MP_" on a 16-byte boundary */
+struct mpf_intel {
+	char signature[4];
+	unsigned long physptr;		/* MP configuration table */
+	unsigned char length;		/* in 16-byte units, 1 */
+	unsigned char specification;
+	unsigned char checksum;
+	unsigned char feature1;		/* non-zero: default configuration */
+	unsigned char feature2;		/* bit 7: IMCR present */
+	unsigned char feature3[3];
+};
+
+struct mpc_table {
+	char signature[4];		/* "PCMP" */
+	unsigned short length;
+	char spec;
+	char checksum;
+	char oem[8];
+	char productid[12];
+	unsigned long oemptr;
+	unsigned short oemsize;
+	unsigned short count;		/* number of entries */
+	unsigned long lapic;
+	unsigned long reserved;
+};
+
+#define MP_PROCESSOR	0		/* 20 bytes, the others are 8 */
+#define MP_IOAPIC	2
+
+#define CPU_ENABLED	1
+#define CPU_BOOTPROCESSOR 2
+
+/*
+ * The local APIC is mapped in the slot kmap() leaves over (see
+ * <linux/mm.h>): its physical address is too high for the identity
+ * mapping.
+ */
+#define APIC_BASE	(PKMAP_BASE + (NR_PKMAP<<12))
+
+#define APIC_ID		0x20
+#define APIC_LVR	0x30
+#define APIC_TPR	0x80
+#define APIC_EOI	0xB0
+#define APIC_SPIV	0xF0
+#define APIC_ICR	0x300
+#define APIC_ICR2	0x310
+#define APIC_LVTT	0x320
+#define APIC_LVT0	0x350
+#define APIC_LVT1	0x360
+#define APIC_LVTERR	0x370
+#define APIC_TMICT	0x380
+#define APIC_TMCCT	0x390
+#define APIC_TDCR	0x3E0
+
+#define APIC_LVT_MASKED		0x10000
+#define APIC_LVT_PERIODIC	0x20000
+#define APIC_DM_NMI		0x00400
+#define APIC_DM_EXTINT		0x00700
+
+#define ICR_INIT	0x00500
+#define ICR_STARTUP	0x00600
+#define ICR_BUSY	0x01000
+#define ICR_ASSERT	0x04000
+#define ICR_LEVEL	0x08000
+
+#define apic_read(reg) (*(volatile unsigned long *) (APIC_BASE+(reg)))
+#define apic_write(reg,val) (*(volatile unsigned long *) (APIC_BASE+(reg)) = (val))
+
+#define RESCHEDULE_VECTOR	0x40
+#define LOCAL_TIMER_VECTOR	0x41
+#define SPURIOUS_VECTOR		0xff
+
+/* the APs start here, in real mode: it has to be below 1MB */
+#define TRAMPOLINE	0x91000
+
+/* what trampoline.S needs to get an AP to start_secondary() */
+struct {
+	long * a;
+	short b;
+	} ap_stack = { NULL, 0x10 };
+unsigned long ap_cr0 = 0, ap_cr4 = 0;
+
+static volatile int ap_callin = 0;
+static int ap_cpu = 0;
+
+/* the count of channel 0 of the 8253, LATCH..1 every tick */
+static long pit_count(void)
+{
+	long count;
+
+	outb_p(0x00,0x43);
+	count = inb_p(0x40);
+	count |= inb_p(0x40) << 8;
+	return count;
+}
+
+/* busy wait for 'clocks' 8253 clocks (1193180 a second) */
+#define CLOCKS(us) ((us)*1193L/1000)
+
+static void pit_wait(long clocks)
+{
+	long last = pit_count(), now;
+
+	while (clocks > 0) {
+		now = pit_count();
+		clocks -= now <= last ? last-now : last+LATCH-now;
+		last = now;
+	}
+}
+
+static int mp_checksum(unsigned char * p, int len)
+{
+	int sum = 0;
+
+	while (len--)
+		sum += *p++;
+	return sum & 0xff;
+}
+
+static struct mpf_intel * mp_scan(unsigned long base, unsigned long length)
+{
+	unsigned long * p = (unsigned long *) base;
+
+	for ( ; length > 0 ; p += 4, length -= 16)
+		if (*p == ('_'|('M'<<8)|('P'<<16)|('_'<<24)) &&
+		    ((struct mpf_intel *) p)->length == 1 &&
+		    !mp_checksum((unsigned char *) p, 16))
+			return (struct mpf_intel *) p;
+	return NULL;
+}
+
+/*
+ * The table only lives in low memory (EBDA, top of base memory, BIOS
+ * ROM), which is identity mapped, and below 16MB in practice. If it
+ * isn't, we just stay uniprocessor.
+ */
+static void mp_read_table(struct mpc_table * mpc)
+{
+	unsigned char * p = (unsigned char *) (mpc+1);
+	int count = mpc->count;
+
+	if (mpc->signature[0] != 'P' || mpc->signature[1] != 'C' ||
+	    mpc->signature[2] != 'M' || mpc->signature[3] != 'P' ||
+	    mp_checksum((unsigned char *) mpc, mpc->length))
+		return;
+	apic_addr = mpc->lapic;
+	while (count--) {
+		if (*p == MP_PROCESSOR) {
+			if ((p[3] & CPU_ENABLED) && mp_nr_cpus < NR_CPUS)
+				mp_apic_id[mp_nr_cpus++] = p[1];
+			p += 20;
+			continue;
+		}
+		if (*p == MP_IOAPIC && !io_apic_addr && (p[3] & 1))
+			io_apic_addr = *(unsigned long *) (p+4);
+		p += 8;
+	}
+}
+
+/*
+ * The boot cpu gets the 8259 through LINT0 and NMIs through LINT1, the
+ * others get neither.
+ */
+static void setup_local_apic(int boot)
+{
+	apic_write(APIC_TPR, 0);
+	apic_write(APIC_SPIV, 0x100 | SPURIOUS_VECTOR);	/* enable */
+	if (boot) {
+		apic_write(APIC_LVT0, APIC_DM_EXTINT);
+		apic_write(APIC_LVT1, APIC_DM_NMI);
+	} else {
+		apic_write(APIC_LVT0, APIC_LVT_MASKED | APIC_DM_EXTINT);
+		apic_write(APIC_LVT1, APIC_LVT_MASKED | APIC_DM_NMI);
+	}
+	apic_write(APIC_LVTERR, APIC_LVT_MASKED);
+}
+
+/*
+ * The APIC timer runs off the bus clock, which has to be measured:
+ * count it (divided by 16) over HZ/10 ticks of the 8253.
+ */
+static unsigned long apic_timer_count = 0;	/* per tick */
+
+static void calibrate_apic_timer(void)
+{
+	apic_write(APIC_TDCR, 0x3);			/* divide by 16 */
+	apic_write(APIC_LVTT, APIC_LVT_MASKED | LOCAL_TIMER_VECTOR);
+	apic_write(APIC_TMICT, 0xffffffff);
+	pit_wait((HZ/10)*LATCH);
+	apic_timer_count = (0xffffffff - apic_read(APIC_TMCCT)) / (HZ/10);
+	apic_write(APIC_TMICT, 0);
+}
+
+static void start_apic_timer(void)
+{
+	apic_write(APIC_TDCR, 0x3);
+	apic_write(APIC_LVTT, APIC_LVT_PERIODIC | LOCAL_TIMER_VECTOR);
+	apic_write(APIC_TMICT, apic_timer_count);
+}
+
+/*
+ * An interrupt handler on this cpu may send an IPI too, so ICR2 and ICR
+ * are written with interrupts off.
+ */
+static void send_ipi(int apicid, unsigned long icr)
+{
+	unsigned long flags;
+	int i = 100000;
+
+	save_flags_cli(flags);
+	while ((apic_read(APIC_ICR) & ICR_BUSY) && --i)
+		/* nothing */ ;
+	apic_write(APIC_ICR2, apicid << 24);
+	apic_write(APIC_ICR, icr);
+	restore_flags(flags);
+}
+
+void smp_send_reschedule(int cpu)
+{
+	send_ipi(cpu_apic_id[cpu], RESCHEDULE_VECTOR);
+}
+
+void smp_reschedule_interrupt(void)
+{
+	apic_write(APIC_EOI, 0);	/* need_resched is set already */
+}
+
+void smp_local_timer_interrupt(long cpl)
+{
+	apic_write(APIC_EOI, 0);
+	do_local_timer(cpl);
+}
+
+static spinlock_t kernel_flag = SPIN_LOCK_UNLOCKED;
+static unsigned long pkmap_seen[NR_CPUS] = {0,};
+
+void lock_kernel(void)
+{
+	unsigned long flags;
+	int cpu;
+
+	save_flags_cli(flags);
+	if (!current->lock_depth++) {
+		spin_lock(&kernel_flag);
+		cpu = smp_processor_id();
+		if (pkmap_seen[cpu] != pkmap_flushes) {	/* see kmap() */
+			pkmap_seen[cpu] = pkmap_flushes;
+			invalidate();
+		}
+	}
+	restore_flags(flags);
+}
+
+void unlock_kernel(void)
+{
+	unsigned long flags;
+
+	save_flags_cli(flags);
+	if (!--current->lock_depth)
+		spin_unlock(&kernel_flag);
+	restore_flags(flags);
+}
+
+/*
+ * Whether p's page directory is in use on another cpu, so that changing
+ * its page tables would leave stale TLB entries there. swap_out() and
+ * try_to_share() leave such tasks alone.
+ */
+int dir_in_use(struct task_struct * p)
+{
+	int i;
+
+	for (i = 0 ; i < smp_num_cpus ; i++)
+		if (i != smp_processor_id() &&
+		    current_set[i]->tss.cr3 == p->tss.cr3)
+			return 1;
+	return 0;
+}
+
+/*
+ * Where an AP ends up from the trampoline: paging is on, and it's on
+ * the stack of its idle task, which smp_boot_cpu() has set up.
+ */
+void start_secondary(void)
+{
+	int cpu = ap_cpu;
+
+	__asm__("pushfl ; andl $0xffffbfff,(%esp) ; popfl");	/* NT */
+	ltr(cpu);
+	lldt(cpu);
+	__asm__("movl %%cr0,%%eax ; orl $8,%%eax ; movl %%eax,%%cr0":::"ax");
+	setup_local_apic(0);
+	ap_callin = 1;
+	lock_kernel();		/* waits until main() lets go */
+	start_apic_timer();
+	printk("SMP: cpu %d (APIC id %d) running\n\r",cpu,cpu_apic_id[cpu]);
+	sti();
+	cpu_idle_loop();
+}
+
+static void smp_boot_cpu(int apicid)
+{
+	struct task_struct * p;
+	int cpu = smp_num_cpus;
+	int i;
+
+	if (!(p = (struct task_struct *) get_free_page()))
+		return;
+	*p = *task[0];
+	p->tss.esp0 = PAGE_SIZE + (long) p;
+	p->processor = cpu;
+	p->lock_depth = 0;
+	p->used_math = 0;
+	idle_set[cpu] = current_set[cpu] = p;
+	cpu_init_tss(cpu,p);
+	ap_stack.a = (long *) (PAGE_SIZE + (long) p);
+	ap_cpu = cpu;
+	ap_callin = 0;
+
+	send_ipi(apicid, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+	pit_wait(CLOCKS(200));
+	send_ipi(apicid, ICR_INIT | ICR_LEVEL);
+	pit_wait(CLOCKS(10000));
+	for (i = 0 ; i < 2 && !ap_callin ; i++) {
+		send_ipi(apicid, ICR_STARTUP | (TRAMPOLINE>>12));
+		pit_wait(CLOCKS(200));
+	}
+	for (i = 0 ; i < 1000 && !ap_callin ; i++)
+		pit_wait(CLOCKS(1000));
+	if (!ap_callin) {
+		printk("SMP: APIC id %d not responding\n\r",apicid);
+		idle_set[cpu] = current_set[cpu] = NULL;
+		free_page((unsigned long) p);
+		return;
+	}
+	cpu_apic_id[cpu] = apicid;
+	smp_num_cpus++;
+}
+
+/*
+ * Called from main() with interrupts still off. The kernel lock is
+ * taken here, before the APs can want it, and main() gives it back when
+ * it goes to user mode.
+ */
+void smp_init(void)
+{
+	struct mpf_intel * mpf;
+	unsigned long ebda = EBDA_SEG << 4;
+	int i;
+
+	lock_kernel();
+	if (!(ebda && (mpf = mp_scan(ebda,1024))) &&
+	    !(mpf = mp_scan(0x9fc00,1024)) &&
+	    !(mpf = mp_scan(0xf0000,0x10000)))
+		return;
+	if (mpf->feature1) {
+		/* default configuration: two processors, APICs at the usual place */
+		mp_nr_cpus = 2;
+		mp_apic_id[0] = 0;
+		mp_apic_id[1] = 1;
+		apic_addr = 0xfee00000;
+		io_apic_addr = 0xfec00000;
+	} else if (mpf->physptr && mpf->physptr < 0x1000000)
+		mp_read_table((struct mpc_table *) mpf->physptr);
+	printk("SMP: %d processor(s), local APIC at %x, IO APIC at %x\n\r",
+		mp_nr_cpus, apic_addr, io_apic_addr);
+	if (mp_nr_cpus < 2 || !apic_addr)
+		return;
+	pkmap_table[NR_PKMAP] = apic_addr | 0x1b;	/* uncached */
+	invalidate();
+	if (!(apic_read(APIC_LVR) & 0xf0)) {
+		printk("SMP: 82489DX APIC, can't start the others\n\r");
+		return;
+	}
+	if (mpf->feature2 & 0x80) {	/* IMCR: from PIC to APIC mode */
+		outb(0x70,0x22);
+		outb(0x01,0x23);
+	}
+	cpu_apic_id[0] = apic_read(APIC_ID) >> 24;
+	setup_local_apic(1);
+	calibrate_apic_timer();
+	set_intr_gate(RESCHEDULE_VECTOR,&reschedule_interrupt);
+	set_intr_gate(LOCAL_TIMER_VECTOR,&apic_timer_interrupt);
+	set_intr_gate(SPURIOUS_VECTOR,&spurious_interrupt);
+	memcpy((char *) TRAMPOLINE, trampoline, trampoline_end - trampoline);
+	__asm__("movl %%cr0,%0":"=r" (ap_cr0));
+	ap_cr0 &= ~8;				/* TS: start_secondary() sets it */
+	__asm__(".byte 0x0f,0x20,0xe0":"=a" (ap_cr4));	/* movl %cr4,%eax */
+	for (i = 0 ; i < mp_nr_cpus && smp_num_cpus < NR_CPUS ; i++)
+		if (mp_apic_id[i] != cpu_apic_id[0])
+			smp_boot_cpu(mp_apic_id[i]);
+	printk("SMP: %d cpus running\n\r",smp_num_cpus);
+}
+
+#endif
@@ -12,6 +12,8 @@
 #include <asm/segment.h>
 #include <sys/times.h>
 #include <sys/utsname.h>
+#include <sys/memstat.h>
+#include <time.h>
 
 int sys_ftime()
 {
@@ -153,22 +155,63 @@ int sys_stime(long * tptr)
 	return 0;
 }
 
+/*
+ * times() reports in CLOCKS_PER_SEC units whatever HZ the kernel was
+ * built with. Done in two steps so that it doesn't overflow.
+ */
+#define TICKS_TO_CLOCKS(t) \
+(((t)/HZ)*CLOCKS_PER_SEC + ((t)%HZ)*CLOCKS_PER_SEC/HZ)
+
 int sys_times(struct tms * tbuf)
 {
 	if (tbuf) {
 		verify_area(tbuf,sizeof *tbuf);
-		put_fs_long(current->utime,(unsigned long *)&tbuf->tms_utime);
-		put_fs_long(current->stime,(unsigned long *)&tbuf->tms_stime);
-		put_fs_long(current->cutime,(unsigned long *)&tbuf->tms_cutime);
-		put_fs_long(current->cstime,(unsigned long *)&tbuf->tms_cstime);
+		put_fs_long(TICKS_TO_CLOCKS(current->utime),(unsigned long *)&tbuf->tms_utime);
+		put_fs_long(TICKS_TO_CLOCKS(current->stime),(unsigned long *)&tbuf->tms_stime);
+		put_fs_long(TICKS_TO_CLOCKS(current->cutime),(unsigned long *)&tbuf->tms_cutime);
+		put_fs_long(TICKS_TO_CLOCKS(current->cstime),(unsigned long *)&tbuf->tms_cstime);
 	}
-	return jiffies;
+	return TICKS_TO_CLOCKS(jiffies);
+}
+
+/*
+ * memstat(pid, buf) - the memory statistics of a task, 0 for current.
+ * This is what a ps-like program reads. verify_area() and put_fs_long()
+ * can sleep, and p could exit meanwhile, so the numbers are taken first.
+ */
+int sys_memstat(int pid, struct memstat * buf)
+{
+	struct task_struct * p = NULL;
+	struct memstat ms;
+	int i;
+
+	if (!pid)
+		p = current;
+	else
+		for (i=0 ; i<NR_TASKS ; i++)
+			if (task[i] && task[i]->pid == pid) {
+				p = task[i];
+				break;
+			}
+	if (!p)
+		return -ESRCH;
+	ms.ms_rss = task_rss(p);
+	ms.ms_minflt = p->min_flt;
+	ms.ms_majflt = p->maj_flt;
+	ms.ms_cowflt = p->cow_flt;
+	verify_area(buf,sizeof *buf);
+	put_fs_long(ms.ms_rss,(unsigned long *)&buf->ms_rss);
+	put_fs_long(ms.ms_minflt,(unsigned long *)&buf->ms_minflt);
+	put_fs_long(ms.ms_majflt,(unsigned long *)&buf->ms_majflt);
+	put_fs_long(ms.ms_cowflt,(unsigned long *)&buf->ms_cowflt);
+	return 0;
 }
 
 int sys_brk(unsigned long end_data_seg)
 {
 	if (end_data_seg >= current->end_code &&
-	    end_data_seg < current->start_stack - 16384)
+	    end_data_seg < current->start_stack - 16384 &&
+	    end_data_seg <= MMAP_BASE)
 		current->brk = end_data_seg;
 	return current->brk;
 }
@@ -21,9 +21,15 @@
  * stored on pages requested from get_free_page().  However, unlike buckets,
  * pages devoted to bucket descriptor pages are never released back to the
  * system.  Fortunately, a system should probably only need 1 or 2 bucket
- * descriptor pages, since a page can hold 256 bucket descriptors (which
- * corresponds to 1 megabyte worth of bucket pages.)  If the kernel is using 
- * that much allocated memory, it's probably doing something wrong.  :-)
+ * descriptor pages, since a page can hold 170 bucket descriptors (which
+ * corresponds to 680 kilobytes worth of bucket pages.)  If the kernel is
+ * using that much allocated memory, it's probably doing something wrong. :-)
+ *
+ * The descriptors of a size are on one of two lists: 'chain' for the
+ * buckets that have free objects, 'full' for those that don't, so
+ * malloc() takes the first one on 'chain'.  free_s() finds the
+ * descriptor of a page through desc_table[], which is indexed by page
+ * number like a page table: neither of them has to search.
  *
  * Note: malloc() and free() both call get_free_page() and free_page()
  *	in sections of code where interrupts are turned off, to allow
@@ -49,17 +55,23 @@
 #include <linux/mm.h>
 #include <asm/system.h>
 
-struct bucket_desc {	/* 16 bytes */
+struct _bucket_dir;
+
+struct bucket_desc {	/* 24 bytes */
 	void			*page;
-	struct bucket_desc	*next;
+	struct bucket_desc	*next, *prev;
 	void			*freeptr;
+	struct _bucket_dir	*dir;
 	unsigned short		refcnt;
 	unsigned short		bucket_size;
 };
 
-struct _bucket_dir {	/* 8 bytes */
+struct _bucket_dir {	/* 20 bytes */
 	int			size;
-	struct bucket_desc	*chain;
+	struct bucket_desc	*chain;		/* buckets with free objects */
+	struct bucket_desc	*full;		/* buckets without */
+	int			nr_pages;	/* statistics, see malloc_stats() */
+	int			nr_objs;
 };
 
 /*
@@ -91,6 +103,55 @@ struct _bucket_dir bucket_dir[] = {
  */
 struct bucket_desc *free_bucket_desc = (struct bucket_desc *) 0;
 
+/*
+ * desc_table[] maps a bucket page to its descriptor: one page of pointers
+ * for every 4MB of address space, got when the first bucket in it is.
+ */
+static struct bucket_desc **desc_table[1024];
+
+#define page_desc(page) \
+(desc_table[(unsigned long) (page) >> 22][((unsigned long) (page) >> 12) & 1023])
+
+/*
+ * Called with interrupts off, like all of the list handling below.
+ */
+static inline void set_page_desc(void *page, struct bucket_desc *bdesc)
+{
+	struct bucket_desc **table;
+
+	if (!desc_table[(unsigned long) page >> 22]) {
+		table = (struct bucket_desc **) get_free_page();
+		if (!table)
+			panic("Out of memory in kernel malloc()");
+		/* get_free_page() may have slept, and someone beaten us to it */
+		if (desc_table[(unsigned long) page >> 22])
+			free_page((unsigned long) table);
+		else
+			desc_table[(unsigned long) page >> 22] = table;
+	}
+	page_desc(page) = bdesc;
+}
+
+static inline void add_bucket(struct bucket_desc **list,
+	struct bucket_desc *bdesc)
+{
+	bdesc->prev = (struct bucket_desc *) 0;
+	if ((bdesc->next = *list))
+		bdesc->next->prev = bdesc;
+	*list = bdesc;
+}
+
+static inline void del_bucket(struct bucket_desc **list,
+	struct bucket_desc *bdesc)
+{
+	if (bdesc->next)
+		bdesc->next->prev = bdesc->prev;
+	if (bdesc->prev)
+		bdesc->prev->next = bdesc->next;
+	else
+		*list = bdesc->next;
+}
+
 /*
  * This routine initializes a bucket description page.
  */
@@ -133,15 +194,12 @@ void *malloc(unsigned int len)
 		panic("malloc: bad arg");
 	}
 	/*
-	 * Now we search for a bucket descriptor which has free space
+	 * Any bucket on the chain has free space
 	 */
 	cli();	/* Avoid race conditions */
-	for (bdesc = bdir->chain; bdesc; bdesc = bdesc->next) 
-		if (bdesc->freeptr)
-			break;
+	bdesc = bdir->chain;
 	/*
-	 * If we didn't find a bucket with free space, then we'll 
-	 * allocate a new one.
+	 * If there isn't one, then we'll allocate a new one.
 	 */
 	if (!bdesc) {
 		char		*cp;
@@ -153,6 +211,7 @@ void *malloc(unsigned int len)
 		free_bucket_desc = bdesc->next;
 		bdesc->refcnt = 0;
 		bdesc->bucket_size = bdir->size;
+		bdesc->dir = bdir;
 		bdesc->page = bdesc->freeptr = (void *) cp = get_free_page();
 		if (!cp)
 			panic("Out of memory in kernel malloc()");
@@ -162,20 +221,25 @@ void *malloc(unsigned int len)
 			cp += bdir->size;
 		}
 		*((char **) cp) = 0;
-		bdesc->next = bdir->chain; /* OK, link it in! */
-		bdir->chain = bdesc;
+		set_page_desc(bdesc->page, bdesc);
+		add_bucket(&bdir->chain, bdesc); /* OK, link it in! */
+		bdir->nr_pages++;
 	}
 	retval = (void *) bdesc->freeptr;
 	bdesc->freeptr = *((void **) retval);
 	bdesc->refcnt++;
+	bdir->nr_objs++;
+	if (!bdesc->freeptr) {
+		del_bucket(&bdir->chain, bdesc);
+		add_bucket(&bdir->full, bdesc);
+	}
 	sti();	/* OK, we're safe again */
 	return(retval);
 }
 
 /*
- * Here is the free routine.  If you know the size of the object that you
- * are freeing, then free_s() will use that information to speed up the
- * search for the bucket descriptor.
+ * Here is the free routine.  The size of the object isn't needed any
+ * more to find its bucket descriptor, but if it is given it's checked.
  * 
  * We will #define a macro so that "free(x)" is becomes "free_s(x, 0)"
  */
@@ -183,45 +247,27 @@ void free_s(void *obj, int size)
 {
 	void		*page;
 	struct _bucket_dir	*bdir;
-	struct bucket_desc	*bdesc, *prev;
+	struct bucket_desc	*bdesc;
 
 	/* Calculate what page this object lives in */
 	page = (void *)  ((unsigned long) obj & 0xfffff000);
-	/* Now search the buckets looking for that page */
-	for (bdir = bucket_dir; bdir->size; bdir++) {
-		prev = 0;
-		/* If size is zero then this conditional is always false */
-		if (bdir->size < size)
-			continue;
-		for (bdesc = bdir->chain; bdesc; bdesc = bdesc->next) {
-			if (bdesc->page == page) 
-				goto found;
-			prev = bdesc;
-		}
-	}
-	panic("Bad address passed to kernel free_s()");
-found:
+	if (!desc_table[(unsigned long) page >> 22] ||
+	    !(bdesc = page_desc(page)) || bdesc->bucket_size < size)
+		panic("Bad address passed to kernel free_s()");
+	bdir = bdesc->dir;
 	cli(); /* To avoid race conditions */
+	if (!bdesc->freeptr) {		/* it's full no more */
+		del_bucket(&bdir->full, bdesc);
+		add_bucket(&bdir->chain, bdesc);
+	}
 	*((void **)obj) = bdesc->freeptr;
 	bdesc->freeptr = obj;
 	bdesc->refcnt--;
+	bdir->nr_objs--;
 	if (bdesc->refcnt == 0) {
-		/*
-		 * We need to make sure that prev is still accurate.  It
-		 * may not be, if someone rudely interrupted us....
-		 */
-		if ((prev && (prev->next != bdesc)) ||
-		    (!prev && (bdir->chain != bdesc)))
-			for (prev = bdir->chain; prev; prev = prev->next)
-				if (prev->next == bdesc)
-					break;
-		if (prev)
-			prev->next = bdesc->next;
-		else {
-			if (bdir->chain != bdesc)
-				panic("malloc bucket chains corrupted");
-			bdir->chain = bdesc->next;
-		}
+		del_bucket(&bdir->chain, bdesc);
+		page_desc(page) = (struct bucket_desc *) 0;
+		bdir->nr_pages--;
 		free_page((unsigned long) bdesc->page);
 		bdesc->next = free_bucket_desc;
 		free_bucket_desc = bdesc;
@@ -230,3 +276,16 @@ found:
 	return;
 }
 
+/*
+ * Bucket utilisation, printed with the task list by show_stat().
+ */
+void malloc_stats(void)
+{
+	struct _bucket_dir	*bdir;
+
+	for (bdir = bucket_dir; bdir->size; bdir++)
+		if (bdir->nr_pages)
+			printk("malloc %d: %d pages, %d of %d objects used\n\r",
+				bdir->size, bdir->nr_pages, bdir->nr_objs,
+				bdir->nr_pages * (PAGE_SIZE/bdir->size));
+}
@@ -0,0 +1,85 @@
+/*
+ *  linux/mm/highmem.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * Temporary kernel mappings of high memory. The kernel only maps
+ * physical memory one to one below PKMAP_BASE; a page above that is
+ * reached by kmap(), which puts it in one of the NR_PKMAP slots of
+ * pkmap_table. That is the page table for the last 4MB below TASK_BASE,
+ * made by paging_init() and shared by all page directories.
+ *
+ * pkmap_count[] is 0 for a free slot, 1 for one that has been given
+ * back but may still be in the TLB, and 1 + the number of users
+ * otherwise. Slots are taken round-robin, and only when the hand comes
+ * back to the start are the given-back ones cleared, with a single TLB
+ * flush for all of them, so kunmap() doesn't have to flush anything.
+ *
+ * The mappings are used from process context only: kmap() sleeps when
+ * all slots are busy. A mapped page can be used for i/o, though, as the
+ * slot stays mapped until kunmap().
+ */
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/kernel.h>
+
+unsigned long * pkmap_table = NULL;
+
+static int pkmap_count[NR_PKMAP];
+static int last_pkmap = 0;
+static struct task_struct * pkmap_wait = NULL;
+#ifdef CONFIG_SMP
+unsigned long pkmap_flushes = 0;
+#endif
+
+static void flush_pkmaps(void)
+{
+	int i;
+
+	for (i = 0 ; i < NR_PKMAP ; i++)
+		if (pkmap_count[i] == 1) {
+			pkmap_count[i] = 0;
+			pkmap_table[i] = 0;
+		}
+	invalidate();
+#ifdef CONFIG_SMP
+	pkmap_flushes++;
+#endif
+}
+
+unsigned long kmap(unsigned long page)
+{
+	int i;
+
+	if (page < highmem_start)
+		return page;
+	for (;;) {
+		for (i = 0 ; i < NR_PKMAP ; i++) {
+			if (++last_pkmap >= NR_PKMAP) {
+				last_pkmap = 0;
+				flush_pkmaps();
+			}
+			if (!pkmap_count[last_pkmap]) {
+				pkmap_count[last_pkmap] = 2;
+				pkmap_table[last_pkmap] = page | 3;	/* kernel only */
+				return PKMAP_BASE + (last_pkmap << 12);
+			}
+		}
+		sleep_on(&pkmap_wait);
+	}
+}
+
+void kunmap(unsigned long addr)
+{
+	int i;
+
+	if (addr < PKMAP_BASE)
+		return;
+	i = (addr - PKMAP_BASE) >> 12;
+	if (pkmap_count[i] < 2)
+		panic("kunmap: page not mapped");
+	if (--pkmap_count[i] == 1)
+		wake_up(&pkmap_wait);
+}
@@ -23,6 +23,7 @@
 #include <signal.h>
 
 #include <asm/system.h>
+#include <asm/spinlock.h>
 
 #include <linux/sched.h>
 #include <linux/head.h>
@@ -36,53 +37,220 @@ static inline volatile void oom(void)
 	do_exit(SIGSEGV);
 }
 
-// 刷新页变换高速缓冲宏函数。 
-// 为了提高地址转换的效率，CPU 将最近使用的页表数据存放在芯片中高速缓冲中。在修改过页表信息之后，就需要刷新该缓冲区。这里使用重新加载页目录基址寄存器 cr3 的方法来进行刷新。下面 eax = 0，是页目录的基址。
-#define invalidate() \
-__asm__("movl %%eax,%%cr3"::"a" (0)) // "a" 赋值 eax = 0
-
-/* these are not to be changed without changing head.s etc */
-#define LOW_MEM 0x100000 // 扩展内存对应物理地址的开始地址（多于1MB的内存为扩展内存）
-#define PAGING_MEMORY (15*1024*1024)
-#define PAGING_PAGES (PAGING_MEMORY>>12) // 0xFFFF00
-#define MAP_NR(addr) (((addr)-LOW_MEM)>>12)
 #define USED 100
 
 #define CODE_SPACE(addr) ((((addr)+4095)&~4095) < \
 current->start_code + current->end_code)
 
-static long HIGH_MEMORY = 0;
+unsigned long HIGH_MEMORY = 0;
+int has_invlpg = 0;
 
 #define copy_page(from,to) \
 __asm__("cld ; rep ; movsl"::"S" (from),"D" (to),"c" (1024):"cx","di","si")
 
-static unsigned char mem_map [ PAGING_PAGES ] = {0,}; // 物理地址空间，以页为单位进行管理，记录引用计数
+/*
+ * mem_map[] has an entry for every page from LOW_MEM to HIGH_MEMORY,
+ * page_order[] only for the low_pages below highmem_start. They are
+ * sized, and placed, by paging_init().
+ *
+ * The kernel maps physical memory one to one below PKMAP_BASE, just
+ * under TASK_BASE. Anything above that is high memory: it is used for
+ * the pages of user space only, which the kernel gets at through the
+ * tasks' page tables, or through kmap() (see highmem.c). Free high
+ * pages aren't on the buddy lists, as those live in the free pages
+ * themselves: they are just the zeroes in that part of mem_map[].
+ */
+unsigned long paging_pages = 0;
+unsigned char * mem_map = NULL; // 物理地址空间，以页为单位进行管理，记录引用计数
+unsigned long highmem_start = 0;
+static unsigned long low_pages = 0;
+long nr_free_highpages = 0;
+static unsigned long high_rotor = 0;
+/* protects mem_map: allocation and freeing can come from several cpus */
+static spinlock_t mem_lock = SPIN_LOCK_UNLOCKED;
+
+/*
+ * Free pages are kept by a buddy allocator: free_area[order] lists the
+ * free blocks of 2^order pages, each aligned to its own size (relative
+ * to LOW_MEM, which is 1MB aligned, so physically too: an order 4 block
+ * never crosses a 64kB DMA boundary). The list links live in the free
+ * pages themselves. page_order[] marks the first page of a free block
+ * with its order; mem_map[] still holds the reference count of every
+ * page, and 0 still means free.
+ */
+#define MAX_ORDER 6			/* blocks of up to 32 pages (128kB) */
+#define FREE_HEAD 0x80
+
+struct free_block {
+	struct free_block * next, * prev;
+};
+
+static struct free_block free_area[MAX_ORDER];
+static unsigned char * page_order = NULL;
+long nr_free_pages = 0;
+
+#define BLOCK_NR(b) MAP_NR((unsigned long) (b))
+#define NR_BLOCK(nr) ((struct free_block *) (LOW_MEM + ((nr)<<12)))
+
+static inline void add_block(unsigned long nr, int order)
+{
+	struct free_block * b = NR_BLOCK(nr);
+
+	b->next = free_area[order].next;
+	b->prev = free_area+order;
+	b->next->prev = b;
+	free_area[order].next = b;
+	page_order[nr] = FREE_HEAD | order;
+}
+
+static inline void del_block(struct free_block * b)
+{
+	b->prev->next = b->next;
+	b->next->prev = b->prev;
+	page_order[BLOCK_NR(b)] = 0;
+}
+
+/*
+ * Put page 'nr' (whose count just went to 0) back, merging it with its
+ * buddy for as long as the buddy is a free block of the same order.
+ * Called with mem_lock held.
+ */
+static void free_one(unsigned long nr)
+{
+	unsigned long buddy;
+	int order = 0;
+
+	nr_free_pages++;
+	while (order < MAX_ORDER-1) {
+		buddy = nr ^ (1 << order);
+		if (buddy >= low_pages || page_order[buddy] != (FREE_HEAD | order))
+			break;
+		del_block(NR_BLOCK(buddy));
+		nr &= ~(1UL << order);
+		order++;
+	}
+	add_block(nr,order);
+}
+
+/*
+ * Pages that the idle task has zeroed already, see zero_idle_pages().
+ * They are allocated pages as far as mem_map is concerned.
+ */
+#define ZERO_POOL 32
+
+static unsigned long zero_pool[ZERO_POOL];
+static int nr_zero_pool = 0;
+
+static unsigned long get_pool_page(void)
+{
+	unsigned long flags, page = 0;
+
+	spin_lock_irqsave(&mem_lock,flags);
+	if (nr_zero_pool)
+		page = zero_pool[--nr_zero_pool];
+	spin_unlock_irqrestore(&mem_lock,flags);
+	return page;
+}
+
+/*
+ * Get 2^order contiguous pages, with a count of 1 each, and return the
+ * physical address of the first. 0 if there is no such block. The pages
+ * can be given back one by one with free_page(), or all together with
+ * free_pages(). They are zeroed if 'zero' is set.
+ */
+static unsigned long __get_free_pages(int order, int zero)
+{
+	struct free_block * b;
+	unsigned long flags, nr, addr;
+	int i;
+
+	if (order < 0 || order >= MAX_ORDER)
+		return 0;
+repeat:
+	spin_lock_irqsave(&mem_lock,flags);
+	for (i = order ; i < MAX_ORDER ; i++)
+		if (free_area[i].next != free_area+i)
+			break;
+	if (i >= MAX_ORDER) {
+		spin_unlock_irqrestore(&mem_lock,flags);
+		if (!order && (addr = get_pool_page()))
+			return addr;
+		if (!order && swap_out())	/* only single pages are worth it */
+			goto repeat;
+		return 0;
+	}
+	b = free_area[i].next;
+	del_block(b);
+	nr = BLOCK_NR(b);
+	while (i > order) {		/* give back the upper halves */
+		i--;
+		add_block(nr + (1 << i),i);
+	}
+	for (i = 0 ; i < (1 << order) ; i++)
+		mem_map[nr+i] = 1;
+	nr_free_pages -= 1 << order;
+	spin_unlock_irqrestore(&mem_lock,flags);
+	if (nr_free_pages < FREE_PAGES_LOW && kswapd_wait)
+		wake_up(&kswapd_wait);
+	addr = LOW_MEM + (nr<<12);
+	if (zero)
+		__asm__("cld ; rep ; stosl"::"a" (0),"D" (addr),
+			"c" (1024 << order):"cx","di");
+	return addr;
+}
+
+unsigned long get_free_pages(int order)
+{
+	return __get_free_pages(order,1);
+}
 
 /*
- * Get physical address of first (actually last :-) free page, and mark it
- * used. If no free pages left, return 0.
+ * Get physical address of a free page, and mark it used. If no free
+ * pages left, return 0. This used to scan mem_map backwards for a zero
+ * byte; now it's the head of a free list.
  */
-// memmap 从高往低找，内存顶头16MB的往低看，0特权，物理页
 unsigned long get_free_page(void)
 {
-register unsigned long __res asm("ax");
+	unsigned long page;
+
+	if ((page = get_pool_page()))
+		return page;
+	return __get_free_pages(0,1);
+}
+
+/*
+ * For callers that fill the whole page themselves (copy-on-write, swap
+ * in): no zeroing, and the pre-zeroed pool is left for the others.
+ */
+unsigned long get_dirty_page(void)
+{
+	return __get_free_pages(0,0);
+}
 
-__asm__("std ; repne ; scasb\n\t" // 方向位置位，用于反响扫描 mem_map[], al(0)与di不等则重复（找引用计数为0的项）
-	"jne 1f\n\t" // 如果没有等于 0 的字节，即找不到空闲项，则跳转结束（返回 0）。
-	"movb $1,1(%%edi)\n\t" // 1->edi+1的内存位置，即mem_map[]中找到的0项，引用计数置1
-	"sall $12,%%ecx\n\t" // Shift Arithmetic Left Long，页面数*4K = 相对页面起始地址 --> 相对于 mem_map。
-	"addl %2,%%ecx\n\t" // 再加上低端内存地址 LOW_MEM，即获得页面实际物理起始地址。
-	"movl %%ecx,%%edx\n\t" // 将页面实际起始地址->edx 寄存器。
-	"movl $1024,%%ecx\n\t" // 寄存器 ecx 置计数值 1024。
-	"leal 4092(%%edx),%%edi\n\t" // 将 4092+edx 的位置->edi(该页面的末端)。
-	"rep ; stosl\n\t" // 将 edi 所指内存清零（反方向，也即将该页面清零）。
-	"movl %%edx,%%eax\n" // 将页面起始地址->eax（返回值）
-	"1:"
-	:"=a" (__res)
-	:"0" (0),"i" (LOW_MEM),"c" (PAGING_PAGES),
-	"D" (mem_map+PAGING_PAGES-1) // mem_map[]的最后一个元素赋值给edx
-	:"di","cx","dx"); // 第3个冒号后是程序中改变过的量
-return __res; // 返回空闲页面地址（如果无空闲则返回 0）。
+/*
+ * Called by the idle task: zero some free pages ahead of time, so that
+ * get_free_page() doesn't have to. It stops as soon as there is
+ * anything else to do, and never takes pages kswapd would want back.
+ */
+void zero_idle_pages(void)
+{
+	unsigned long flags, page;
+
+	while (nr_zero_pool < ZERO_POOL && nr_free_pages > FREE_PAGES_HIGH &&
+	       !need_resched) {
+		if (!(page = __get_free_pages(0,0)))
+			return;
+		__asm__("cld ; rep ; stosl"::"a" (0),"D" (page),
+			"c" (1024):"cx","di");
+		spin_lock_irqsave(&mem_lock,flags);
+		if (nr_zero_pool < ZERO_POOL) {
+			zero_pool[nr_zero_pool++] = page;
+			page = 0;
+		}
+		spin_unlock_irqrestore(&mem_lock,flags);
+		if (page)
+			free_page(page);
+	}
 }
 
 /*
@@ -91,45 +259,223 @@ return __res; // 返回空闲页面地址（如果无空闲则返回 0）。
  */
 void free_page(unsigned long addr)
 {
+	unsigned long flags;
+
 	if (addr < LOW_MEM) return;
 	if (addr >= HIGH_MEMORY)
 		panic("trying to free nonexistent page");
 	addr -= LOW_MEM;
 	addr >>= 12;
-	if (mem_map[addr]--) return;
-	mem_map[addr]=0;
+	spin_lock_irqsave(&mem_lock,flags);
+	if (mem_map[addr] > 1) {
+		mem_map[addr]--;
+		spin_unlock_irqrestore(&mem_lock,flags);
+		return;
+	}
+	if (mem_map[addr]) {
+		mem_map[addr] = 0;
+		if (addr >= low_pages)
+			nr_free_highpages++;
+		else
+			free_one(addr);
+		spin_unlock_irqrestore(&mem_lock,flags);
+		return;
+	}
+	spin_unlock_irqrestore(&mem_lock,flags);
 	panic("trying to free free page");
 }
 
+/*
+ * A free page of high memory, or 0 if there is none. They are found by
+ * going round mem_map[] from where the last one was taken.
+ */
+static unsigned long get_high_page(void)
+{
+	unsigned long flags, nr;
+
+	spin_lock_irqsave(&mem_lock,flags);
+	if (!nr_free_highpages) {
+		spin_unlock_irqrestore(&mem_lock,flags);
+		return 0;
+	}
+	nr = high_rotor;
+	do {
+		if (++nr >= paging_pages)
+			nr = low_pages;
+	} while (mem_map[nr]);
+	mem_map[nr] = 1;
+	nr_free_highpages--;
+	high_rotor = nr;
+	spin_unlock_irqrestore(&mem_lock,flags);
+	return LOW_MEM + (nr<<12);
+}
+
+/*
+ * Pages for user space: from high memory while there is any, so that
+ * the memory the kernel can address directly is kept for itself.
+ * get_user_page() zeroes the page, get_dirty_user_page() is for when
+ * it's going to be filled in anyway. Either may sleep.
+ */
+unsigned long get_user_page(void)
+{
+	unsigned long page, addr;
+
+	if (!(page = get_high_page()))
+		return get_free_page();
+	addr = kmap(page);
+	__asm__("cld ; rep ; stosl"::"a" (0),"D" (addr),"c" (1024):"cx","di");
+	kunmap(addr);
+	return page;
+}
+
+unsigned long get_dirty_user_page(void)
+{
+	unsigned long page;
+
+	if ((page = get_high_page()))
+		return page;
+	return get_dirty_page();
+}
+
+/*
+ * copy_page() for pages that may be in high memory. The copy is done
+ * before the caller changes any page table, as kmap() may sleep.
+ */
+static void copy_user_page(unsigned long from, unsigned long to)
+{
+	from = kmap(from);
+	to = kmap(to);
+	copy_page(from,to);
+	kunmap(to);
+	kunmap(from);
+}
+
+void free_pages(unsigned long addr, int order)
+{
+	int i;
+
+	for (i = 0 ; i < (1 << order) ; i++, addr += PAGE_SIZE)
+		free_page(addr);
+}
+
+/*
+ * Drops one reference to a page table. The last one frees the pages in
+ * it as well: page tables can be shared by fork, see below.
+ */
+static void put_pg_table(unsigned long table)
+{
+	unsigned long *pg_table = (unsigned long *) table;
+	unsigned long nr;
+
+	if (mem_map[MAP_NR(table)] > 1) {
+		free_page(table);
+		return;
+	}
+	for (nr=0 ; nr<1024 ; nr++) {
+		if (1 & *pg_table)
+			free_page(0xfffff000 & *pg_table);
+		else if (*pg_table)
+			swap_free(*pg_table >> 1);
+		*pg_table = 0;
+		pg_table++;
+	}
+	free_page(table);
+}
+
+/*
+ * Frees 'size' page-directory entries worth of page tables, and the
+ * pages in them, starting at 'dir'.
+ */
+static void free_pg_dir_range(unsigned long * dir,unsigned long size)
+{
+	for ( ; size-->0 ; dir++) {
+		if (!(1 & *dir))
+			continue;
+		put_pg_table(0xfffff000 & *dir);
+		*dir = 0;
+		cond_resched();
+	}
+}
+
 /*
  * This function frees a continuos block of page tables, as needed
  * by 'exit()'. As does copy_page_tables(), this handles only 4Mb blocks.
  */
 int free_page_tables(unsigned long from,unsigned long size)
 {
-	unsigned long *pg_table;
-	unsigned long * dir, nr;
-
 	if (from & 0x3fffff)
 		panic("free_page_tables called with wrong alignment");
-	if (!from)
+	if (from < TASK_BASE)
 		panic("Trying to free up swapper memory space");
-	size = (size + 0x3fffff) >> 22;
-	dir = (unsigned long *) ((from>>20) & 0xffc); /* _pg_dir = 0 */
-	for ( ; size-->0 ; dir++) {
-		if (!(1 & *dir))
+	free_pg_dir_range(pg_dir_entry(current,from),(size + 0x3fffff) >> 22);
+	invalidate();
+	return 0;
+}
+
+/*
+ * new_page_dir() gets a page directory for a new task, with the kernel
+ * part filled in from the swapper's pg_dir. Returns 0 if out of memory.
+ */
+unsigned long new_page_dir(void)
+{
+	unsigned long dir;
+
+	if (!(dir = get_free_page()))
+		return 0;
+	__asm__("cld ; rep ; movsl"::"S" (pg_dir),"D" (dir),
+		"c" (KERNEL_PGD_ENTRIES):"cx","di","si");
+	return dir;
+}
+
+/*
+ * free_page_dir() releases everything a task has mapped in user space,
+ * and then the page directory itself. It's used when the task is
+ * released (or fork failed), so 'p' isn't the one running.
+ */
+void free_page_dir(struct task_struct * p)
+{
+	if (p->tss.cr3 == (unsigned long) pg_dir)
+		return;
+	free_pg_dir_range(pg_dir_entry(p,TASK_BASE),TASK_SIZE>>22);
+	free_page(p->tss.cr3);
+	p->tss.cr3 = 0;
+}
+
+/*
+ * Copies 'nr' entries of a page table, making the pages copy-on-write:
+ * they are write-protected on both sides, and their count goes up.
+ * Returns -1 if a swapped out page couldn't be read back in.
+ */
+static int copy_pg_table(unsigned long * from_page_table,
+	unsigned long * to_page_table, unsigned long nr)
+{
+	unsigned long this_page;
+	int i;
+
+	/* 页表：循环空间：每一个页表 4KB 的地址拷贝 */
+	for ( ; nr-- > 0 ; from_page_table++,to_page_table++) {
+repeat:
+		this_page = *from_page_table; // 赋值父进程的页表项
+		if (!(1 & this_page)) { // present位为1，存在则拷贝
+			if (!this_page)
+				continue;
+			if ((i = swap_dup(from_page_table,to_page_table)) < 0)
+				return -1;	/* swapped out, and no page to read it into */
+			if (!i)
+				goto repeat;	/* changed while we slept */
 			continue;
-		pg_table = (unsigned long *) (0xfffff000 & *dir);
-		for (nr=0 ; nr<1024 ; nr++) {
-			if (1 & *pg_table)
-				free_page(0xfffff000 & *pg_table);
-			*pg_table = 0;
-			pg_table++;
 		}
-		free_page(0xfffff000 & *dir);
-		*dir = 0;
+		// 因为所有的共享，非数据所有者，只有只读权限，所以pte[1]=r/w=0。如果要写，就只能 copy on write,写时复制 COW
+		this_page &= ~2;                        // 除了010即第二位，其他全部保留, 即 this page 只读
+		*to_page_table = this_page;             // 赋值给子进程
+		// NOTE lyq: 这里进程 0 page 640KB，没有到 1MB，所以进程 0 不会进入 if 内部，仍然拥有写权限。
+		if (this_page > LOW_MEM) {              // 如果 this_page < LOW_MEM, 即1MB以内的内存，不参与mem_map管理，因为 mem_map只管理扩展内存
+			*from_page_table = this_page;       // 对于共享的内存，无论是父进程还是子进程，都不再拥有写权限（要不然父进程写了，会改变子进程的数据）
+			this_page -= LOW_MEM;               // 从 LOW_MEM 开始算起，即从 1MB 以外的内存从0开始计数
+			this_page >>= 12;                   // mem_map，以页为单位，所以 >>=12
+			mem_map[this_page]++;
+		}
 	}
-	invalidate();
 	return 0;
 }
 
@@ -151,23 +497,22 @@ int free_page_tables(unsigned long from,unsigned long size)
  * special case for nr=xxxx.
  */
 // NOTE lyq: 必考题，复制页表
-int copy_page_tables(unsigned long from,unsigned long to,long size)
+int copy_page_tables(unsigned long from,unsigned long to,unsigned long size,
+	struct task_struct * p)
 {
 	unsigned long * from_page_table;
 	unsigned long * to_page_table;
-	unsigned long this_page;
 	unsigned long * from_dir, * to_dir;
-	unsigned long nr;
 
 	// 20+2 = 22, 4MB地址空间的最后一个地址，这个大小刚好是页目录表的一个表项的管辖范围 / 一张页表的管辖范围
 	// 保证 from/to 的低 22 位全为 0, 即保证地址 4MB 对齐 --> CPU 要求页表对齐
 	if ((from&0x3fffff) || (to&0x3fffff))
 		panic("copy_page_tables called with wrong alignment");
-	// 获取页目录地址 0xffc, 0b1111-1111-1100，即抹掉这12位的低2位，因为一个页目录表项是4B，故这里的 from_dir 表示页目录表项的位置
-	from_dir = (unsigned long *) ((from>>20) & 0xffc); /* _pg_dir = 0, pg dir base 为 0*/
-	to_dir = (unsigned long *) ((to>>20) & 0xffc);
+	// 获取页目录项的位置：from 在当前进程（父进程）的页目录中，to 在子进程 p 的页目录中
+	from_dir = pg_dir_entry(current,from);
+	to_dir = pg_dir_entry(p,to);
 	// size + 0x3fffff 向上取整； >> 22 得到 size 需要分配多少个页表项，不满一个页表项，按1个页表项算
-	size = ((unsigned) (size+0x3fffff)) >> 22;
+	size = (size+0x3fffff) >> 22;
 	/* 页表项 */
 	for( ; size-->0 ; from_dir++,to_dir++) {
 		// 判断 to_dir 的低 1 位，该位表示存在位 valid
@@ -176,29 +521,27 @@ int copy_page_tables(unsigned long from,unsigned long to,long size)
 		// 判断父进程是否给自己分配内存
 		if (!(1 & *from_dir)) // from_dir 不存在
 			continue;
+		/*
+		 * Not the first fork: share the page table itself, write-
+		 * protected in both directories. Whoever wants to change
+		 * something in it first gets a copy, see unshare_pg_table().
+		 */
+		if (from) {
+			*from_dir &= ~2;
+			*to_dir = *from_dir;
+			mem_map[MAP_NR(0xfffff000 & *from_dir)]++;
+			continue;
+		}
 		// 赋值父进程表项
 		from_page_table = (unsigned long *) (0xfffff000 & *from_dir);
 		// get_free_page，申请页，用于存放页表
 		if (!(to_page_table = (unsigned long *) get_free_page()))
 			return -1;	/* Out of memory, see freeing */
 		*to_dir = ((unsigned long) to_page_table) | 7;  // 7 (user/rw/存在) 确定权限
-		nr = (from==0)?0xA0:1024; // 如果为进程0(data_base=0x0)，则分配 160项，640KB；如果不是，则分配 1024项，4 MB --> 因为进程0限长 160；不是的话，就会把一整张页表都给子进程
-		/* 页表：循环空间：每一个页表 4KB 的地址拷贝 */
-		for ( ; nr-- > 0 ; from_page_table++,to_page_table++) {
-			this_page = *from_page_table; // 赋值父进程的页表项
-			if (!(1 & this_page)) // present位为1，存在则拷贝
-				continue;
-			// 因为所有的共享，非数据所有者，只有只读权限，所以pte[1]=r/w=0。如果要写，就只能 copy on write,写时复制 COW
-			this_page &= ~2;                        // 除了010即第二位，其他全部保留, 即 this page 只读
-			*to_page_table = this_page;             // 赋值给子进程
-			// NOTE lyq: 这里进程 0 page 640KB，没有到 1MB，所以进程 0 不会进入 if 内部，仍然拥有写权限。
-			if (this_page > LOW_MEM) {              // 如果 this_page < LOW_MEM, 即1MB以内的内存，不参与mem_map管理，因为 mem_map只管理扩展内存
-				*from_page_table = this_page;       // 对于共享的内存，无论是父进程还是子进程，都不再拥有写权限（要不然父进程写了，会改变子进程的数据）
-				this_page -= LOW_MEM;               // 从 LOW_MEM 开始算起，即从 1MB 以外的内存从0开始计数
-				this_page >>= 12;                   // mem_map，以页为单位，所以 >>=12
-				mem_map[this_page]++;
-			}
-		}
+		// 进程0(data_base=0x0)只拷贝 160项，640KB，因为进程0限长 160
+		if (copy_pg_table(from_page_table,to_page_table,0xA0))
+			return -1;
+		cond_resched();
 	}
 	// 刷新 CR3 页目录项寄存器--> 刷新TLB
 	invalidate();
@@ -213,52 +556,115 @@ int copy_page_tables(unsigned long from,unsigned long to,long size)
  * page: 页地址；address: 线性空间地址
  * 一个内存页面放置在指定地址处。它返回页面的物理地址，如果内存不够(在访问页表或页面时)，则返回 0。
  */
-unsigned long put_page(unsigned long page,unsigned long address)
+static unsigned long __put_page(unsigned long page,unsigned long address,
+	unsigned long flags)
 {
 	unsigned long tmp, *page_table;
 
-/* NOTE !!! This uses the fact that _pg_dir=0 */
-
-	if (page < LOW_MEM || page >= HIGH_MEMORY) // 非正常范围
+	if (page == ZERO_PAGE)
+		;
+	else if (page < LOW_MEM || page >= HIGH_MEMORY) // 非正常范围
 		printk("Trying to put page %p at %p\n",page,address);
-	if (mem_map[(page-LOW_MEM)>>12] != 1) // 如果申请的页面在内存页面映射字节图中没有置位，则显示警告信息
+	else if (mem_map[(page-LOW_MEM)>>12] != 1) // 如果申请的页面在内存页面映射字节图中没有置位，则显示警告信息
 		printk("mem_map disagrees with %p at %p\n",page,address);
-	// 计算指定地址在页目录表中对应的目录项指针
+	// 计算指定地址在当前进程页目录表中对应的目录项指针
 	// 1. from 页目录表[页目录偏移] get 页表基址
-	page_table = (unsigned long *) ((address>>20) & 0xffc); // 0x 1111 1111 1100, 剩下两位0b00表示一项4字节
+	page_table = pg_dir_entry(current,address);
 	if ((*page_table)&1)
 		// 如果该目录项有效(P=1)(也即指定的页表在内存中)，则从中取得指定页表的地址->page_table
-		page_table = (unsigned long *) (0xfffff000 & *page_table); // 默认_pg_dir=0
+		page_table = (unsigned long *) (0xfffff000 & *page_table);
 	else {
 		// 不存在，申请空闲页面给页表使用
 		if (!(tmp=get_free_page()))
 			return 0;
-		*page_table = tmp|7; // U/S, R/W, P
-		page_table = (unsigned long *) tmp;
+		if ((*page_table)&1)	/* got one while we slept */
+			free_page(tmp);
+		else
+			*page_table = tmp|7; // U/S, R/W, P
+		page_table = (unsigned long *) (0xfffff000 & *page_table);
 	}
 	// 2. set 页表[页表偏移]=物理页面，每个页表共可有 1024 项(0x3ff)。
-	page_table[(address>>12) & 0x3ff] = page | 7; // U/S, R/W, P
+	page_table[(address>>12) & 0x3ff] = page | flags; // U/S, R/W, P
 /* no need for invalidate，不需要刷新页变换高速缓冲 */
 	return page;
 }
 
-void un_wp_page(unsigned long * table_entry)
+unsigned long put_page(unsigned long page,unsigned long address)
+{
+	return __put_page(page,address,7);
+}
+
+/*
+ * Like put_page(), but for a page the kernel has filled in with data
+ * that exists nowhere else (exec arguments): the dirty bit tells
+ * swap_out() it has to be written out, and not just dropped.
+ */
+unsigned long put_dirty_page(unsigned long page,unsigned long address)
+{
+	return __put_page(page,address,PAGE_DIRTY | 7);
+}
+
+/*
+ * Gives current a page table of its own for 'address', if it shares it
+ * with others since fork (the directory entry is read-only then). The
+ * pages in the copy become copy-on-write, as fork used to do up front.
+ * Anything that changes a page-table entry of current goes through
+ * here first.
+ */
+void unshare_pg_table(unsigned long address)
+{
+	unsigned long * dir = pg_dir_entry(current,address);
+	unsigned long old_table, new_table;
+
+	if ((3 & *dir) != 1)		/* not there, or writable already */
+		return;
+	old_table = 0xfffff000 & *dir;
+	if (mem_map[MAP_NR(old_table)] == 1) {	/* the others went away */
+		*dir |= 2;
+		invalidate();
+		return;
+	}
+	if (!(new_table = get_free_page()))
+		oom();
+	if (copy_pg_table((unsigned long *) old_table,
+	    (unsigned long *) new_table,1024)) {
+		put_pg_table(new_table);
+		oom();
+	}
+	*dir = new_table | 7;
+	invalidate();
+	put_pg_table(old_table);
+}
+
+void un_wp_page(unsigned long * table_entry, unsigned long address)
 {
 	unsigned long old_page,new_page;
 
 	old_page = 0xfffff000 & *table_entry;
 	if (old_page >= LOW_MEM && mem_map[MAP_NR(old_page)]==1) { // 如果当前计数为1
 		*table_entry |= 2; // 直接获得写权限
-		invalidate(); // 刷新TLB
+		invalidate_page(address); // 刷新这一页的 TLB
 		return;
 	}
-	if (!(new_page=get_free_page())) // 申请新页面
+	current->cow_flt++;
+	if (!(new_page = (old_page == ZERO_PAGE) ? get_user_page() :
+	    get_dirty_user_page())) // 申请新页面，要复制的就不用先清零
 		oom();
-	if (old_page >= LOW_MEM)
-		mem_map[MAP_NR(old_page)]--; // 页面引用计数--
-	*table_entry = new_page | 7; // 新页面更改页表项并设置属性
-	invalidate(); // 刷新TLB
-	copy_page(old_page,new_page); // 复制页面
+	if (old_page != ZERO_PAGE) // get_user_page() 给的已经是全 0 的页
+		copy_user_page(old_page,new_page); // 复制页面
+/*
+ * Getting the page (or mapping it to copy it) may have slept, and
+ * swap_out() can drop a clean shared page like this one meanwhile (or
+ * write it out). Then the entry isn't ours to change any more, and what
+ * we copied may be rubbish: the write faults again and starts over.
+ */
+	if ((*table_entry & 0xfffff003) != (old_page | 1)) {
+		free_page(new_page);
+		return;
+	}
+	*table_entry = new_page | (PAGE_DIRTY | 7); // 新页面更改页表项并设置属性；置 D 位，swap_out() 不能当干净页丢掉
+	invalidate_page(address); // 刷新这一页的 TLB
+	free_page(old_page); // 页面引用计数--，别人这期间都走了的话就释放
 }	
 
 /*
@@ -276,9 +682,16 @@ void do_wp_page(unsigned long error_code,unsigned long address)
 	if (CODE_SPACE(address))
 		do_exit(SIGSEGV);
 #endif
-	un_wp_page((unsigned long *)
-		(((address>>10) & 0xffc) + (0xfffff000 &
-		*((unsigned long *) ((address>>20) &0xffc)))));
+	unsigned long * table_entry;
+
+	unshare_pg_table(address);
+	table_entry = (unsigned long *) (((address>>10) & 0xffc) +
+		(0xfffff000 & *pg_dir_entry(current,address)));
+	if ((3 & *table_entry) != 1)	/* the fault may only have been the table */
+		return;
+	current->min_flt++;
+	if (!mmap_wp_page(table_entry,address))
+		un_wp_page(table_entry,address);
 
 }
 
@@ -286,21 +699,35 @@ void write_verify(unsigned long address)
 {
 	unsigned long page;
 
-	if (!( (page = *((unsigned long *) ((address>>20) & 0xffc)) )&1))
+	unshare_pg_table(address);
+	if (!( (page = *pg_dir_entry(current,address)) &1))
 		return;
 	page &= 0xfffff000;
 	page += ((address>>10) & 0xffc);
-	if ((3 & *(unsigned long *) page) == 1)  /* non-writeable, present */
-		un_wp_page((unsigned long *) page);
+	/* un_wp_page() gives up if the page went away while it slept */
+	while ((3 & *(unsigned long *) page) == 1)  /* non-writeable, present */
+		if (!mmap_wp_page((unsigned long *) page,address))
+			un_wp_page((unsigned long *) page,address);
 	return;
 }
 
 // 取得一页空闲内存并映射到指定线性地址处
+/*
+ * A read of anonymous memory that was never written maps the shared
+ * zero page read-only: the first write goes through do_wp_page(), which
+ * gives the task a page of its own.
+ */
+static void get_zero_page(unsigned long address)
+{
+	if (!__put_page(ZERO_PAGE,address,5)) // U/S, P, 只读
+		oom();
+}
+
 void get_empty_page(unsigned long address)
 {
 	unsigned long tmp;
 
-	if (!(tmp=get_free_page()) || !put_page(tmp,address)) {
+	if (!(tmp=get_user_page()) || !put_page(tmp,address)) {
 		free_page(tmp);		/* 0 is ok - ignored */
 		oom();
 	}
@@ -322,9 +749,8 @@ static int try_to_share(unsigned long address, struct task_struct * p)
 	unsigned long to_page;
 	unsigned long phys_addr;
 
-	from_page = to_page = ((address>>20) & 0xffc);
-	from_page += ((p->start_code>>20) & 0xffc);
-	to_page += ((current->start_code>>20) & 0xffc);
+	from_page = (unsigned long) pg_dir_entry(p,p->start_code+address);
+	to_page = (unsigned long) pg_dir_entry(current,current->start_code+address);
 /* is there a page-directory at from? */
 	from = *(unsigned long *) from_page;
 	if (!(from & 1))
@@ -339,11 +765,8 @@ static int try_to_share(unsigned long address, struct task_struct * p)
 	if (phys_addr >= HIGH_MEMORY || phys_addr < LOW_MEM)
 		return 0;
 	to = *(unsigned long *) to_page;
-	if (!(to & 1))
-		if (to = get_free_page())
-			*(unsigned long *) to_page = to | 7;
-		else
-			oom();
+	if (!(to & 1))			/* share_page() made it */
+		return 0;
 	to &= 0xfffff000;
 	to_page = to + ((address>>10) & 0xffc);
 	if (1 & *(unsigned long *) to_page)
@@ -351,7 +774,7 @@ static int try_to_share(unsigned long address, struct task_struct * p)
 /* share them: write-protect */
 	*(unsigned long *) from_page &= ~2;
 	*(unsigned long *) to_page = *(unsigned long *) from_page;
-	invalidate();
+	invalidate_page(current->start_code+address);
 	phys_addr -= LOW_MEM;
 	phys_addr >>= 12;
 	mem_map[phys_addr]++;
@@ -364,95 +787,347 @@ static int try_to_share(unsigned long address, struct task_struct * p)
  * to the current data space.
  *
  * We first check if it is at all feasible by checking executable->i_count.
- * It should be >1 if there are other tasks sharing this inode.
+ * It should be >1 if there are other tasks sharing this inode. The tasks
+ * running an executable are on its i_mmap list, so we don't have to go
+ * through all of task[] to find them.
+ *
+ * The page table is made first, as that may sleep: once we look at the
+ * other tasks, nothing may sleep until the page has been shared, or
+ * they could unmap it (or exit) under us.
  */
 static int share_page(unsigned long address)
 {
-	struct task_struct ** p;
+	struct task_struct * p;
+	unsigned long * dir, tmp;
 
 	if (!current->executable)
 		return 0;
 	if (current->executable->i_count < 2) // 如果只能单独执行(executable->i_count=1)，也退出。
 		return 0;
-	for (p = &LAST_TASK ; p > &FIRST_TASK ; --p) {
-		if (!*p)
-			continue;
-		if (current == *p)
-			continue;
-		if ((*p)->executable != current->executable)
+	dir = pg_dir_entry(current,current->start_code+address);
+	if (!(1 & *dir)) {
+		if (!(tmp = get_free_page()))
+			oom();
+		if (1 & *dir)
+			free_page(tmp);
+		else
+			*dir = tmp | 7;
+	}
+	for (p = current->executable->i_mmap ; p ; p = p->mmap_next) {
+		if (current == p || dir_in_use(p))	/* its TLB: see smp.c */
 			continue;
-		if (try_to_share(address,*p)) // 可执行文件相同时才共享
+		if (try_to_share(address,p)) // 可执行文件相同时才共享
 			return 1;
 	}
 	return 0;
 }
 
+/*
+ * Put p on (or take it off) the i_mmap list of its executable. This has
+ * to be done whenever p->executable is set or dropped.
+ */
+void add_mapping(struct task_struct * p)
+{
+	struct m_inode * inode = p->executable;
+
+	if (!inode)
+		return;
+	p->mmap_prev = NULL;
+	if ((p->mmap_next = inode->i_mmap))
+		p->mmap_next->mmap_prev = p;
+	inode->i_mmap = p;
+}
+
+void del_mapping(struct task_struct * p)
+{
+	if (!p->executable)
+		return;
+	if (p->mmap_next)
+		p->mmap_next->mmap_prev = p->mmap_prev;
+	if (p->mmap_prev)
+		p->mmap_prev->mmap_next = p->mmap_next;
+	else
+		p->executable->i_mmap = p->mmap_next;
+	p->mmap_next = p->mmap_prev = NULL;
+}
+
+/*
+ * Fault-around: when a page of the executable has been faulted in, the
+ * next few pages in the same page table are mapped as well if that is
+ * cheap - another task has them, or all their blocks are in the buffer
+ * cache already. For the others read-ahead is started, so that their own
+ * fault won't have to wait as long. Not done when memory is getting low.
+ */
+#define FAULT_AROUND 8
+#define FAULT_AROUND_MIN_FREE 64
+
+static void fault_around(unsigned long address)
+{
+	unsigned long * page_table;
+	unsigned long tmp, addr, page = 0;
+	int nr[4];
+	int block,i,n;
+
+	page_table = (unsigned long *) (0xfffff000 &
+		*pg_dir_entry(current,address));
+	for (n = 0 ; n < FAULT_AROUND ; n++) {
+		address += PAGE_SIZE;
+		if (!(address & 0x3fffff))	/* that's the next page table */
+			break;
+		tmp = address - current->start_code;
+		if (tmp >= current->end_data)
+			break;
+		if (page_table[(address>>12) & 0x3ff])
+			continue;
+		if (share_page(tmp))
+			continue;
+		block = 1 + tmp/BLOCK_SIZE;
+		for (i=0 ; i<4 ; block++,i++)
+			nr[i] = bmap(current->executable,block);
+		if (!page && nr_free_pages + nr_free_highpages >= FAULT_AROUND_MIN_FREE)
+			page = get_user_page();
+		if (!page) {
+			breada_page(current->executable->i_dev,nr);
+			continue;
+		}
+		addr = kmap(page);
+		if (!cached_page(addr,current->executable->i_dev,nr)) {
+			kunmap(addr);
+			breada_page(current->executable->i_dev,nr);
+			continue;
+		}
+		i = tmp + 4096 - current->end_data;
+		tmp = addr + 4096;
+		while (i-- > 0)
+			*(char *) --tmp = 0;
+		kunmap(addr);
+		if (!put_page(page,address))
+			break;
+		page = 0;
+	}
+	free_page(page);		/* 0 is ok - ignored */
+}
+
 void do_no_page(unsigned long error_code,unsigned long address)
 {
 	int nr[4];
 	unsigned long tmp;
-	unsigned long page;
+	unsigned long page, vaddr;
 	int block,i;
 
 	address &= 0xfffff000; // 取其所在页的起始地址
+	unshare_pg_table(address);
+	page = *pg_dir_entry(current,address);
+	if (page & 1) {
+		page = (page & 0xfffff000) + ((address>>10) & 0xffc);
+		if (*(unsigned long *) page) { // 页表项不为 0 但不存在：被换出去了
+			current->maj_flt++;
+			swap_in((unsigned long *) page);
+			return;
+		}
+	}
+	if (mmap_no_page(error_code,address)) // mmap() 映射的文件
+		return;
 	tmp = address - current->start_code; // 相较于代码段起始地址的偏移
 	if (!current->executable || tmp >= current->end_data) { // 非加载程序导致缺页 --> 直接申请页面即可 --> tmp >= current->end_data, 如压栈时申请空闲页面
-		get_empty_page(address);
+		current->min_flt++;
+		if (error_code & 2) // 写引起的缺页
+			get_empty_page(address);
+		else
+			get_zero_page(address);
 		return;
 	}
-	if (share_page(tmp)) // 能共享就共享
+	if (share_page(tmp)) { // 能共享就共享
+		current->min_flt++;
+		fault_around(address);
 		return;
-	if (!(page = get_free_page()))
+	}
+	current->maj_flt++;
+	if (!(page = get_user_page()))
 		oom(); // out of memory 内存不够用，终止进程
+	vaddr = kmap(page); // 高端内存的页面要先映射进内核才能读写
 /* remember that 1 block is used for header */
 	block = 1 + tmp/BLOCK_SIZE; // 块号对应，之所以加一，是之前文件头读了一个数据块，start_code是在读了这个数据块之后才设置的
 	for (i=0 ; i<4 ; block++,i++) // 1块 1KB，1页 4KB
 		nr[i] = bmap(current->executable,block); // 根据 i 节点信息，取数据块在设备上的对应的逻辑块号
 	// 1. 设备数据（current->executable->i_dev,nr，这里是虚拟盘载入） --> 物理空间（page）
-	bread_page(page,current->executable->i_dev,nr); // 读设备上，一个页面的数据（4 个逻辑块）到指定物理地址 page 处
+	bread_page(vaddr,current->executable->i_dev,nr); // 读设备上，一个页面的数据（4 个逻辑块）到 page 映射的地址处
 	i = tmp + 4096 - current->end_data; // 在增加了一页内存后，该页内存的部分可能会超过进程的 end_data 位置。
-	tmp = page + 4096;
+	tmp = vaddr + 4096;
 	while (i-- > 0) {
 		tmp--;
 		*(char *)tmp = 0; // 物理页面超出的部分清零处理
 	}
+	kunmap(vaddr);
 	// 2. 物理空间(page) -> 线性空间(address)
-	if (put_page(page,address))
+	if (put_page(page,address)) {
+		fault_around(address);
 		return;
+	}
 	free_page(page);
 	oom();
 	// 2023.12.18 17:20 完结撒花
 }
 
-void mem_init(long start_mem, long end_mem)
+/*
+ * A 486 or later can toggle the AC flag (bit 18) in eflags, a 386
+ * can't. That's the cpu check for invlpg.
+ */
+static int cpu_is_486(void)
+{
+	unsigned long flags;
+
+	__asm__("pushfl ; popl %%eax ; movl %%eax,%%ecx\n\t"
+		"xorl $0x40000,%%eax ; pushl %%eax ; popfl\n\t"
+		"pushfl ; popl %%eax ; xorl %%ecx,%%eax\n\t"
+		"pushl %%ecx ; popfl"
+		:"=a" (flags)::"cx");
+	return (flags & 0x40000) != 0;
+}
+
+/*
+ * Page size extension: cpuid (if the ID flag, bit 21, can be toggled)
+ * function 1 says so in edx bit 3. cpuid and cr4 are spelled out in
+ * bytes, like invlpg.
+ */
+static int cpu_has_pse(void)
+{
+	unsigned long flags, features;
+
+	__asm__("pushfl ; popl %%eax ; movl %%eax,%%ecx\n\t"
+		"xorl $0x200000,%%eax ; pushl %%eax ; popfl\n\t"
+		"pushfl ; popl %%eax ; xorl %%ecx,%%eax\n\t"
+		"pushl %%ecx ; popfl"
+		:"=a" (flags)::"cx");
+	if (!(flags & 0x200000))
+		return 0;
+	__asm__(".byte 0x0f,0xa2"		/* cpuid */
+		:"=d" (features):"a" (1):"bx","cx");
+	return (features & 8) != 0;
+}
+
+#define PDE_4MB 0x80
+
+/*
+ * head.s only maps the first 16MB. paging_init() maps the rest of
+ * physical memory, up to PKMAP_BASE, into pg_dir; the last 4MB below
+ * TASK_BASE get the page table kmap() works in, and the memory above
+ * PKMAP_BASE (if any) is high memory. The page tables, mem_map[] and
+ * page_order[] are taken from the start of main memory. The new kernel
+ * entries are copied into every page directory by new_page_dir(), so
+ * this must be done before the first fork. Returns the new start of
+ * main memory.
+ *
+ * With PSE the kernel mapping is made of 4MB pages instead, so that it
+ * takes a few TLB entries and no page tables at all. Only the first 4MB
+ * keep pg0: task 0 runs in it, and fork copies it page by page.
+ */
+unsigned long paging_init(unsigned long start_mem, unsigned long end_mem)
+{
+	unsigned long * dir, * pg_table;
+	unsigned long addr;
+	int i;
+
+	has_invlpg = cpu_is_486();
+	highmem_start = end_mem < PKMAP_BASE ? end_mem : PKMAP_BASE;
+	start_mem = (start_mem + 4095) & ~4095;
+	if (cpu_has_pse()) {
+		__asm__(".byte 0x0f,0x20,0xe0\n\t"	/* movl %%cr4,%%eax */
+			"orl $0x10,%%eax\n\t"
+			".byte 0x0f,0x22,0xe0"		/* movl %%eax,%%cr4 */
+			:::"ax");
+		dir = pg_dir + 1;			/* 4MB */
+		for (addr = 0x400000 ; addr < 16*1024*1024 || addr < highmem_start ;
+		     dir++, addr += 0x400000)
+			*dir = addr | PDE_4MB | 7;
+	} else {
+		dir = pg_dir + 4;			/* 16MB */
+		for (addr = 16*1024*1024 ; addr < highmem_start ; dir++) {
+			pg_table = (unsigned long *) start_mem;
+			start_mem += PAGE_SIZE;
+			*dir = ((unsigned long) pg_table) | 7;
+			for (i = 0 ; i < 1024 ; i++, addr += PAGE_SIZE)
+				*pg_table++ = addr < highmem_start ? (addr | 7) : 0;
+		}
+	}
+	pkmap_table = (unsigned long *) start_mem;
+	start_mem += PAGE_SIZE;
+	for (i = 0 ; i < 1024 ; i++)
+		pkmap_table[i] = 0;
+	pg_dir[PKMAP_BASE>>22] = ((unsigned long) pkmap_table) | 7;
+	invalidate();
+	paging_pages = (end_mem - LOW_MEM) >> 12;
+	low_pages = (highmem_start - LOW_MEM) >> 12;
+	mem_map = (unsigned char *) start_mem;
+	start_mem += paging_pages;
+	page_order = (unsigned char *) start_mem;
+	start_mem += low_pages;
+	for (i = 0 ; i < low_pages ; i++)
+		page_order[i] = 0;
+	return (start_mem + 4095) & ~4095;
+}
+
+void mem_init(unsigned long start_mem, unsigned long end_mem)
 {
 	int i;
 
 	HIGH_MEMORY = end_mem;
-	for (i=0 ; i<PAGING_PAGES ; i++)
+	for (i=0 ; i<MAX_ORDER ; i++)
+		free_area[i].next = free_area[i].prev = free_area+i;
+	for (i=0 ; i<paging_pages ; i++)
 		mem_map[i] = USED; // 使用的数量，USED 默认设置为100，一般进程有 64，不可能到100，说明这块数据不允许人再申请
-	i = MAP_NR(start_mem);
-	end_mem -= start_mem;
-	end_mem >>= 12; // end_mem 目前表示 page 的数量
-	while (end_mem-->0)
-		mem_map[i++]=0;
+	for (i = MAP_NR(start_mem) ; i < low_pages ; i++) {
+		mem_map[i]=0;
+		free_one(i);	// 挂到伙伴系统的空闲链表上，能合并就合并
+	}
+	for ( ; i < paging_pages ; i++) {	// 高端内存不进伙伴系统
+		mem_map[i]=0;
+		nr_free_highpages++;
+	}
+	high_rotor = low_pages;
+}
+
+/*
+ * Resident set size: the pages p has present in its user space. Pages
+ * in page tables shared since fork count for every task sharing them.
+ */
+long task_rss(struct task_struct * p)
+{
+	unsigned long * dir, * pg_tbl;
+	long rss = 0;
+	int i,j;
+
+	dir = pg_dir_entry(p,TASK_BASE);
+	for (i=0 ; i<(TASK_SIZE>>22) ; i++) {
+		if (!(1&dir[i]))
+			continue;
+		pg_tbl = (unsigned long *) (0xfffff000 & dir[i]);
+		for (j=0 ; j<1024 ; j++)
+			if (pg_tbl[j]&1)
+				rss++;
+	}
+	return rss;
 }
 
 void calc_mem(void)
 {
-	int i,j,k,free=0;
-	long * pg_tbl;
+	int i,n,free=0;
 
-	for(i=0 ; i<PAGING_PAGES ; i++)
+	for(i=0 ; i<paging_pages ; i++)
 		if (!mem_map[i]) free++;
-	printk("%d pages free (of %d)\n\r",free,PAGING_PAGES);
-	for(i=2 ; i<1024 ; i++) {
-		if (1&pg_dir[i]) {
-			pg_tbl=(long *) (0xfffff000 & pg_dir[i]);
-			for(j=k=0 ; j<1024 ; j++)
-				if (pg_tbl[j]&1)
-					k++;
-			printk("Pg-dir[%d] uses %d pages\n",i,k);
-		}
+	printk("%d pages free (of %d), %d of them high\n\r",free,paging_pages,
+		nr_free_highpages);
+	for(i=0 ; i<MAX_ORDER ; i++) {
+		struct free_block * b;
+
+		for (n=0, b=free_area[i].next ; b != free_area+i ; b=b->next)
+			n++;
+		printk("%d*%dkB ",n,4<<i);
+	}
+	printk("\n\r");
+	for(n=1 ; n<NR_TASKS ; n++) {
+		if (!task[n])
+			continue;
+		printk("Task[%d] uses %d pages\n",n,task_rss(task[n]));
 	}
 }
@@ -0,0 +1,415 @@
+/*
+ *  linux/mm/mmap.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * mmap() and munmap(). A mapping is just a vm_area in the task: nothing
+ * is read until do_no_page() finds the faulting address in one, and
+ * then a page of the file is read in through the buffer cache, the same
+ * way demand loading of executables works.
+ *
+ * MAP_PRIVATE pages are ordinary anonymous pages once they are in, so
+ * fork makes them copy-on-write and they can be swapped. MAP_SHARED
+ * pages are shared with any other task that has the same part of the
+ * file mapped shared, stay shared over fork, and are written back into
+ * the buffer cache when they are unmapped (munmap, exec or exit) if they
+ * are dirty. Until then they stay in memory: swap_out() leaves them.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/kernel.h>
+#include <asm/segment.h>
+#include <asm/system.h>
+
+volatile void do_exit(long code);
+
+static struct vm_area * find_area(struct task_struct * p, unsigned long address)
+{
+	struct vm_area * area;
+
+	for (area = p->mmap ; area < p->mmap + NR_MMAP ; area++)
+		if (area->inode && address >= area->start && address < area->end)
+			return area;
+	return NULL;
+}
+
+/*
+ * The page-table entry for 'address' in current, with a page table made
+ * if there is none. Returns NULL if out of memory.
+ */
+static unsigned long * get_pte(unsigned long address)
+{
+	unsigned long * dir = pg_dir_entry(current,address);
+	unsigned long tmp;
+
+	if (!(1 & *dir)) {
+		if (!(tmp = get_free_page()))
+			return NULL;
+		if (1 & *dir)		/* got one while we slept */
+			free_page(tmp);
+		else
+			*dir = tmp | 7;
+	}
+	return (unsigned long *) ((0xfffff000 & *dir) + ((address>>10) & 0xffc));
+}
+
+/*
+ * Another task with the same part of the file mapped shared may have
+ * the page in already: then we map that one too. The page can be dirty,
+ * which is fine, it's the file's contents that we want. get_pte() is
+ * done first, as it can sleep: nothing may change between finding the
+ * page and taking our reference to it. Returns 1 also if the page got
+ * mapped in while we slept.
+ */
+static int share_file_page(struct vm_area * area, unsigned long address,
+	unsigned long flags)
+{
+	struct task_struct ** p;
+	struct vm_area * from;
+	unsigned long pos, from_addr, from_page, * to_page;
+
+	if (!(to_page = get_pte(address)))
+		return 0;
+	if (1 & *to_page)
+		return 1;
+	pos = address - area->start + area->offset;
+	for (p = &LAST_TASK ; p > &FIRST_TASK ; --p) {
+		if (!*p || (*p)->tss.cr3 == current->tss.cr3)
+			continue;
+		if (dir_in_use(*p))	/* its TLB: see smp.c */
+			continue;
+		for (from = (*p)->mmap ; from < (*p)->mmap + NR_MMAP ; from++) {
+			if (from->inode != area->inode || !(from->flags & MAP_SHARED))
+				continue;
+			if (pos < from->offset ||
+			    pos >= from->offset + from->end - from->start)
+				continue;
+			from_addr = from->start + pos - from->offset;
+			from_page = *pg_dir_entry(*p,from_addr);
+			if (!(1 & from_page))
+				continue;
+			from_page = *(unsigned long *) ((0xfffff000 & from_page) +
+				((from_addr>>10) & 0xffc));
+			if (!(1 & from_page))
+				continue;
+			from_page &= 0xfffff000;
+			*to_page = from_page | flags;
+			mem_map[MAP_NR(from_page)]++;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void read_file_page(struct vm_area * area, unsigned long address,
+	unsigned long page)
+{
+	struct m_inode * inode = area->inode;
+	unsigned long pos = address - area->start + area->offset;
+	int nr[4];
+	int i;
+
+	for (i=0 ; i<4 ; i++)
+		nr[i] = (pos + i*BLOCK_SIZE < inode->i_size) ?
+			bmap(inode,pos/BLOCK_SIZE + i) : 0;
+	page = kmap(page);
+	bread_page(page,inode->i_dev,nr);
+	if (pos + PAGE_SIZE > inode->i_size) {	/* past the end of file: zero */
+		i = (pos < inode->i_size) ? inode->i_size - pos : 0;
+		memset((char *) page + i,0,PAGE_SIZE - i);
+	}
+	kunmap(page);
+}
+
+/*
+ * Writes a dirty MAP_SHARED page back into the buffer cache. Only the
+ * blocks inside the file are written: mmap() never makes a file longer.
+ */
+static void write_file_page(struct vm_area * area, unsigned long address,
+	unsigned long page)
+{
+	struct m_inode * inode = area->inode;
+	unsigned long pos = address - area->start + area->offset;
+	struct buffer_head * bh;
+	unsigned long addr;
+	int i, block;
+
+	addr = kmap(page);
+	for (i=0 ; i<4 ; i++, pos += BLOCK_SIZE) {
+		if (pos >= inode->i_size)
+			break;
+		if (!(block = create_block(inode,pos/BLOCK_SIZE)))
+			break;
+		if (!(bh = bread(inode->i_dev,block)))
+			break;
+		memcpy(bh->b_data,(char *) addr + i*BLOCK_SIZE,BLOCK_SIZE);
+		bh->b_dirt = 1;
+		brelse(bh);
+	}
+	kunmap(addr);
+	inode->i_mtime = CURRENT_TIME;
+	inode->i_dirt = 1;
+}
+
+/*
+ * Called by do_no_page() first: returns 0 if 'address' isn't mapped,
+ * and do_no_page() goes on as usual.
+ */
+int mmap_no_page(unsigned long error_code, unsigned long address)
+{
+	struct vm_area * area;
+	unsigned long page, flags, * pte;
+
+	if (!(area = find_area(current,address)))
+		return 0;
+	address &= 0xfffff000;
+	if ((error_code & 2) && !(area->prot & PROT_WRITE))
+		do_exit(SIGSEGV);
+	flags = (area->prot & PROT_WRITE) ? 7 : 5;
+	if (area->flags & MAP_SHARED) {
+		flags |= PAGE_SHARED_FILE;
+		if (share_file_page(area,address,flags)) {
+			current->min_flt++;
+			return 1;
+		}
+	}
+	current->maj_flt++;
+	if (!(page = get_user_page())) {
+		printk("out of memory\n\r");
+		do_exit(SIGSEGV);
+	}
+	read_file_page(area,address,page);
+	/* somebody else may have read it in while we slept */
+	if ((area->flags & MAP_SHARED) && share_file_page(area,address,flags)) {
+		free_page(page);
+		return 1;
+	}
+	if (!(pte = get_pte(address))) {
+		free_page(page);
+		printk("out of memory\n\r");
+		do_exit(SIGSEGV);
+	}
+	if (1 & *pte) {		/* mapped in while we slept */
+		free_page(page);
+		return 1;
+	}
+	*pte = page | flags;
+	return 1;
+}
+
+/*
+ * Called for a write to a present, write-protected page, before it is
+ * made copy-on-write. A MAP_SHARED page is shared on purpose (also after
+ * fork), so it just gets write access. Returns 0 if it's an ordinary
+ * copy-on-write page after all.
+ */
+int mmap_wp_page(unsigned long * table_entry, unsigned long address)
+{
+	struct vm_area * area;
+
+	if (!(area = find_area(current,address)))
+		return 0;
+	if (!(area->prot & PROT_WRITE))
+		do_exit(SIGSEGV);
+	if (!(area->flags & MAP_SHARED))
+		return 0;
+	*table_entry |= 2;
+	invalidate_page(address);
+	return 1;
+}
+
+/*
+ * Throws away the pages of [start,end) in current, writing dirty shared
+ * ones of 'area' back first. With no area, it's whatever was there.
+ */
+static void unmap_pages(struct vm_area * area, unsigned long start,
+	unsigned long end)
+{
+	unsigned long address, page, * pte;
+
+	for (address = start ; address < end ; address += PAGE_SIZE) {
+		if (!(1 & *pg_dir_entry(current,address))) {
+			address |= 0x3ff000;	/* nothing in this page table */
+			continue;
+		}
+		unshare_pg_table(address);
+		pte = (unsigned long *) ((0xfffff000 & *pg_dir_entry(current,address)) +
+			((address>>10) & 0xffc));
+		if (!(page = *pte))
+			continue;
+		*pte = 0;
+		if (!(1 & page)) {
+			swap_free(page >> 1);
+			continue;
+		}
+		if (area && (area->flags & MAP_SHARED) && (page & PAGE_DIRTY))
+			write_file_page(area,address,0xfffff000 & page);
+		free_page(0xfffff000 & page);
+	}
+	invalidate();
+}
+
+/*
+ * Unmaps the linear range [start,end) from the areas that have pages in
+ * it. An area may lose its head or tail, or be split in two if there's
+ * a free slot for the second half.
+ */
+static int do_munmap(unsigned long start, unsigned long end)
+{
+	struct vm_area * area, * tmp;
+
+	for (area = current->mmap ; area < current->mmap + NR_MMAP ; area++) {
+		if (!area->inode || area->end <= start || area->start >= end)
+			continue;
+		if (area->start < start && area->end > end) {
+			for (tmp = current->mmap ; tmp < current->mmap + NR_MMAP ; tmp++)
+				if (!tmp->inode)
+					break;
+			if (tmp >= current->mmap + NR_MMAP)
+				return -ENOMEM;
+			*tmp = *area;
+			tmp->offset += end - area->start;
+			tmp->start = end;
+			area->inode->i_count++;
+			unmap_pages(area,start,end);
+			area->end = start;
+			continue;
+		}
+		if (area->start < start) {
+			unmap_pages(area,start,area->end);
+			area->end = start;
+		} else if (area->end > end) {
+			unmap_pages(area,area->start,end);
+			area->offset += end - area->start;
+			area->start = end;
+		} else {
+			unmap_pages(area,area->start,area->end);
+			iput(area->inode);
+			area->inode = NULL;
+		}
+	}
+	return 0;
+}
+
+/*
+ * exec and exit: all mappings go. A vfork() child doesn't own the pages
+ * (they are the parent's), it only gives back its inode references.
+ */
+void exit_mmap(void)
+{
+	struct vm_area * area;
+
+	for (area = current->mmap ; area < current->mmap + NR_MMAP ; area++) {
+		if (!area->inode)
+			continue;
+		if (!current->vfork_parent)
+			unmap_pages(area,area->start,area->end);
+		iput(area->inode);
+		area->inode = NULL;
+	}
+}
+
+/*
+ * First fit from MMAP_BASE up. Returns 0 if there is no room.
+ */
+static unsigned long get_unmapped_area(unsigned long base, unsigned long len)
+{
+	unsigned long addr = base + MMAP_BASE;
+	struct vm_area * area;
+
+repeat:
+	if (addr + len > base + MMAP_END || addr + len < addr)
+		return 0;
+	for (area = current->mmap ; area < current->mmap + NR_MMAP ; area++)
+		if (area->inode && area->start < addr + len && area->end > addr) {
+			addr = area->end;
+			goto repeat;
+		}
+	return addr;
+}
+
+/*
+ * mmap() has six arguments, more than fit in registers, so user space
+ * passes a pointer to them: addr, len, prot, flags, fd, off. Returns the
+ * address relative to the data segment.
+ */
+int sys_mmap(unsigned long * buffer)
+{
+	unsigned long addr, len, base, start;
+	int prot, flags, fd, i;
+	unsigned long off;
+	struct file * file;
+	struct m_inode * inode;
+	struct vm_area * area;
+
+	addr = get_fs_long(buffer);
+	len = get_fs_long(buffer+1);
+	prot = get_fs_long(buffer+2);
+	flags = get_fs_long(buffer+3);
+	fd = get_fs_long(buffer+4);
+	off = get_fs_long(buffer+5);
+	if (current->vfork_parent)
+		return -EINVAL;
+	if (!len || (off & 0xfff) || (addr & 0xfff))
+		return -EINVAL;
+	if ((flags & (MAP_SHARED|MAP_PRIVATE)) == 0 ||
+	    (flags & (MAP_SHARED|MAP_PRIVATE)) == (MAP_SHARED|MAP_PRIVATE))
+		return -EINVAL;
+	if (fd >= NR_OPEN || fd < 0 || !(file = current->filp[fd]))
+		return -EBADF;
+	inode = file->f_inode;
+	if (!inode || !S_ISREG(inode->i_mode))
+		return -EACCES;
+	/* f_mode is the inode's mode (see sys_open()): the open mode is in f_flags */
+	if ((file->f_flags & O_ACCMODE) == O_WRONLY)
+		return -EACCES;
+	if ((flags & MAP_SHARED) && (prot & PROT_WRITE) &&
+	    (file->f_flags & O_ACCMODE) != O_RDWR)
+		return -EACCES;
+	len = (len + 0xfff) & 0xfffff000;
+	base = get_base(current->ldt[2]);
+	if (flags & MAP_FIXED) {
+		if (addr + len > MMAP_END || addr + len < addr)
+			return -EINVAL;
+		start = base + addr;
+		if ((i = do_munmap(start,start + len)))
+			return i;
+		unmap_pages(NULL,start,start + len);
+	} else if (!(start = get_unmapped_area(base,len)))
+		return -ENOMEM;
+	for (area = current->mmap ; area < current->mmap + NR_MMAP ; area++)
+		if (!area->inode)
+			break;
+	if (area >= current->mmap + NR_MMAP)
+		return -ENOMEM;
+	area->start = start;
+	area->end = start + len;
+	area->offset = off;
+	area->prot = prot;
+	area->flags = flags;
+	area->inode = inode;
+	inode->i_count++;
+	return start - base;
+}
+
+int sys_munmap(unsigned long addr, unsigned long len)
+{
+	unsigned long base;
+
+	if (current->vfork_parent)
+		return -EINVAL;
+	if ((addr & 0xfff) || !len || addr + len > TASK_SIZE || addr + len < addr)
+		return -EINVAL;
+	len = (len + 0xfff) & 0xfffff000;
+	base = get_base(current->ldt[2]);
+	return do_munmap(base + addr,base + addr + len);
+}
@@ -0,0 +1,148 @@
+/*
+ *  linux/mm/slab.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * Object caches for the small structures the kernel used to keep in
+ * fixed tables (inodes, files, block requests). A cache takes whole
+ * pages ("slabs") from get_free_page() and cuts them into objects of
+ * one size. Each slab starts with its header; the free objects in it are
+ * chained through their first word, so allocating and freeing are a few
+ * pointer moves, and the slab of an object is found by masking its
+ * address. Objects are rounded up to L1_CACHE_BYTES, so that no two of
+ * them share a cache line.
+ *
+ * A cache has a list of the slabs that still have free objects. A slab
+ * that becomes completely free is given back, unless it's the only one
+ * on the list: that one is kept, or a cache hovering around a page
+ * boundary would get and free a page every time.
+ *
+ * The constructor (if any) is called once for each object when its slab
+ * is made, not on every allocation: objects are to be freed in their
+ * constructed state.
+ */
+#include <stddef.h>
+
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <asm/spinlock.h>
+
+struct slab {
+	struct slab * next, * prev;	/* on the cache's partial list */
+	void * free;			/* first free object */
+	int inuse;
+	struct kmem_cache * cache;
+};
+
+#define SLAB_HDR L1_CACHE_ALIGN(sizeof(struct slab))
+#define slab_of(objp) ((struct slab *) ((unsigned long) (objp) & 0xfffff000))
+
+/*
+ * Requests are freed from interrupts (end_request()), so all of this is
+ * done with interrupts off.
+ */
+static spinlock_t slab_lock = SPIN_LOCK_UNLOCKED;
+
+static inline void add_partial(struct kmem_cache * cachep, struct slab * s)
+{
+	s->prev = NULL;
+	if ((s->next = cachep->partial))
+		s->next->prev = s;
+	cachep->partial = s;
+}
+
+static inline void del_partial(struct kmem_cache * cachep, struct slab * s)
+{
+	if (s->next)
+		s->next->prev = s->prev;
+	if (s->prev)
+		s->prev->next = s->next;
+	else
+		cachep->partial = s->next;
+}
+
+/*
+ * Make a new slab and put it on the partial list. get_free_page() may
+ * sleep, so this is called without the lock, and another slab may have
+ * appeared meanwhile: that doesn't matter, both are used.
+ */
+static int grow_cache(struct kmem_cache * cachep)
+{
+	struct slab * s;
+	char * objp;
+	unsigned long page, flags;
+	int i, nr;
+
+	if (!(page = get_free_page()))
+		return 0;
+	s = (struct slab *) page;
+	s->inuse = 0;
+	s->cache = cachep;
+	s->free = NULL;
+	nr = (PAGE_SIZE - SLAB_HDR) / cachep->size;
+	objp = (char *) page + SLAB_HDR + (nr-1)*cachep->size;
+	for (i = 0 ; i < nr ; i++, objp -= cachep->size) {
+		if (cachep->ctor)
+			cachep->ctor(objp);
+		*(void **) objp = s->free;
+		s->free = objp;
+	}
+	spin_lock_irqsave(&slab_lock,flags);
+	add_partial(cachep,s);
+	cachep->nr_slabs++;
+	spin_unlock_irqrestore(&slab_lock,flags);
+	return 1;
+}
+
+/*
+ * Returns NULL only if there is no memory for a new slab. Must not be
+ * called from an interrupt if that can happen, as getting the page may
+ * sleep.
+ */
+void * kmem_cache_alloc(struct kmem_cache * cachep)
+{
+	struct slab * s;
+	void * objp;
+	unsigned long flags;
+
+	spin_lock_irqsave(&slab_lock,flags);
+	while (!(s = cachep->partial)) {
+		spin_unlock_irqrestore(&slab_lock,flags);
+		if (!grow_cache(cachep))
+			return NULL;
+		spin_lock_irqsave(&slab_lock,flags);
+	}
+	objp = s->free;
+	s->free = *(void **) objp;
+	s->inuse++;
+	if (!s->free)			/* full: off the list */
+		del_partial(cachep,s);
+	cachep->nr_objs++;
+	spin_unlock_irqrestore(&slab_lock,flags);
+	return objp;
+}
+
+void kmem_cache_free(struct kmem_cache * cachep, void * objp)
+{
+	struct slab * s = slab_of(objp);
+	unsigned long flags;
+
+	if (s->cache != cachep)
+		panic("kmem_cache_free: object not in this cache");
+	spin_lock_irqsave(&slab_lock,flags);
+	if (!s->free)			/* was full, so not on the list */
+		add_partial(cachep,s);
+	*(void **) objp = s->free;
+	s->free = objp;
+	cachep->nr_objs--;
+	if (--s->inuse || (cachep->partial == s && !s->next)) {
+		spin_unlock_irqrestore(&slab_lock,flags);
+		return;
+	}
+	del_partial(cachep,s);
+	cachep->nr_slabs--;
+	spin_unlock_irqrestore(&slab_lock,flags);
+	free_page((unsigned long) s);
+}
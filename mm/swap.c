@@ -0,0 +1,319 @@
+/*
+ *  linux/mm/swap.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * This file should contain most things doing the swapping from/to disk.
+ *
+ * The swap device is one page-sized slot per bit: page 0 of the device
+ * is a bitmap of the usable slots (set = free), with "SWAP-SPACE" in its
+ * last 10 bytes, so slot 0 is never used and a swap entry is never 0.
+ * It's turned on with swapon(), and the bitmap stays in memory.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/kernel.h>
+#include <asm/system.h>
+
+#define SWAP_BITS (4096<<3)
+
+volatile void do_exit(long code);
+
+#define bitop(name,op) \
+static inline int name(char * addr,unsigned int nr) \
+{ \
+int __res; \
+__asm__ __volatile__("bt" op " %1,%2; adcl $0,%0" \
+	:"=g" (__res) \
+	:"r" (nr),"m" (*(addr)),"0" (0)); \
+return __res; \
+}
+
+bitop(bit,"")
+bitop(setbit,"s")
+bitop(clrbit,"r")
+
+static char * swap_bitmap = NULL;
+static int swap_dev = 0;
+
+/*
+ * Only one page is written out at a time: swap_writing is its slot, so
+ * that a task faulting on that very page waits for the write to finish
+ * instead of reading the slot before it is there.
+ */
+static int swap_writing = 0;
+static struct task_struct * swap_wait = NULL;
+
+#define read_swap_page(nr,buffer) ll_rw_page(READ,swap_dev,(nr),(buffer))
+#define write_swap_page(nr,buffer) ll_rw_page(WRITE,swap_dev,(nr),(buffer))
+
+static int get_swap_page(void)
+{
+	int nr;
+
+	if (!swap_bitmap)
+		return 0;
+	for (nr = 1 ; nr < SWAP_BITS ; nr++)
+		if (clrbit(swap_bitmap,nr))
+			return nr;
+	return 0;
+}
+
+void swap_free(int swap_nr)
+{
+	if (!swap_nr)
+		return;
+	if (swap_bitmap && swap_nr < SWAP_BITS)
+		if (!setbit(swap_bitmap,swap_nr))
+			return;
+	printk("Swap-space bad (swap_free())\n\r");
+}
+
+/* 'page' may be in high memory */
+static void read_swap(int swap_nr, unsigned long page)
+{
+	unsigned long addr;
+
+	while (swap_writing == swap_nr)
+		sleep_on(&swap_wait);
+	addr = kmap(page);
+	read_swap_page(swap_nr,(char *) addr);
+	kunmap(addr);
+}
+
+/*
+ * Bring the page at *table_ptr back in, and give its swap slot back:
+ * the page is marked dirty, as it now exists only in memory.
+ */
+void swap_in(unsigned long * table_ptr)
+{
+	int swap_nr;
+	unsigned long page;
+
+	if (!swap_bitmap) {
+		printk("Trying to swap in without swap bit-map");
+		return;
+	}
+	if (1 & *table_ptr) {
+		printk("trying to swap in present page\n\r");
+		return;
+	}
+	swap_nr = *table_ptr >> 1;
+	if (!swap_nr) {
+		printk("No swap page in swap_in\n\r");
+		return;
+	}
+	if (!(page = get_dirty_user_page())) {
+		printk("out of memory\n\r");
+		do_exit(SIGSEGV);
+	}
+	read_swap(swap_nr,page);
+	if (*table_ptr != swap_nr<<1) {	/* it went away while we slept */
+		free_page(page);
+		return;
+	}
+	if (setbit(swap_bitmap,swap_nr))
+		printk("swapping in multiply from same page\n\r");
+	*table_ptr = page | (PAGE_DIRTY | 7);
+}
+
+/*
+ * Used by fork for an entry that is swapped out: the parent gets the
+ * page back in memory, the child inherits the swap slot. Returns -1 if
+ * there is no page to read it into, and 0 if the entry changed while
+ * we slept (the table may still be shared with another task, which can
+ * have swapped it in meanwhile): the caller has to look at it again.
+ */
+int swap_dup(unsigned long * from_entry, unsigned long * to_entry)
+{
+	unsigned long page;
+	int swap_nr = *from_entry >> 1;
+
+	if (!(page = get_dirty_user_page()))
+		return -1;
+	read_swap(swap_nr,page);
+	if (*from_entry != swap_nr<<1) {
+		free_page(page);
+		return 0;
+	}
+	*to_entry = swap_nr<<1;
+	*from_entry = page | (PAGE_DIRTY | 7);
+	return 1;
+}
+
+/*
+ * Second chance: a page that has been used since the last time the
+ * clock came by only loses its accessed bit. A clean page is dropped
+ * (it can be read in again from the executable or the mapped file, or
+ * is all zeroes), a dirty one is written out if nobody else shares it
+ * and there is a swap device. So this works without swap as well.
+ */
+static int try_to_swap_out(unsigned long * table_ptr, unsigned long address)
+{
+	unsigned long page;
+	int swap_nr;
+
+	page = *table_ptr;
+	if (!(PAGE_PRESENT & page))
+		return 0;
+	if (PAGE_ACCESSED & page) {
+		*table_ptr = page & ~PAGE_ACCESSED;
+		return 0;
+	}
+	if ((page & 0xfffff000) < LOW_MEM || (page & 0xfffff000) >= HIGH_MEMORY)
+		return 0;
+	if (PAGE_DIRTY & page) {
+		if (PAGE_SHARED_FILE & page)	/* belongs in the file, see mmap.c */
+			return 0;
+		page &= 0xfffff000;
+		if (mem_map[MAP_NR(page)] != 1)
+			return 0;
+		if (!(swap_nr = get_swap_page()))
+			return 0;
+		*table_ptr = swap_nr<<1;
+		invalidate_page(address);	/* the table may be current's too */
+		swap_writing = swap_nr;
+		address = kmap(page);
+		write_swap_page(swap_nr, (char *) address);
+		kunmap(address);
+		swap_writing = 0;
+		wake_up(&swap_wait);
+		free_page(page);
+		return 1;
+	}
+	*table_ptr = 0;
+	invalidate_page(address);
+	free_page(page & 0xfffff000);
+	return 1;
+}
+
+/*
+ * The clock hand: a task, and a page table and entry in its user space.
+ * It goes round all tasks at most twice per call, as the first time
+ * round may only clear accessed bits.
+ */
+static int swap_task = 1;
+static int swap_pde = 0, swap_pte = 0;
+
+int swap_out(void)
+{
+	struct task_struct * p;
+	unsigned long * dir, * pg_table;
+	int tries = 2*NR_TASKS;
+
+	if (current == task[0])
+		return 0;
+	if (swap_writing) {		/* somebody is at it already */
+		while (swap_writing)
+			sleep_on(&swap_wait);
+		return 1;
+	}
+	while (tries-- > 0) {
+		if ((p = task[swap_task]) && !dir_in_use(p)) {	/* TLBs */
+			dir = pg_dir_entry(p,TASK_BASE);
+			for ( ; swap_pde < (TASK_SIZE>>22) ; swap_pde++, swap_pte = 0) {
+				if (!(1 & dir[swap_pde]))
+					continue;
+				pg_table = (unsigned long *) (0xfffff000 & dir[swap_pde]);
+				for ( ; swap_pte < 1024 ; swap_pte++)
+					if (try_to_swap_out(pg_table+swap_pte,TASK_BASE+
+					    (swap_pde<<22)+(swap_pte<<12))) {
+						swap_pte++;
+						return 1;
+					}
+			}
+		}
+		swap_pde = swap_pte = 0;
+		if (++swap_task >= NR_TASKS)
+			swap_task = 1;
+	}
+	return 0;
+}
+
+/*
+ * The pageout daemon, a kernel thread. It is started by kswapd_init()
+ * once the root is mounted (from sys_setup()), and its pid is whatever
+ * comes after init's.
+ */
+struct task_struct * kswapd_wait = NULL;
+
+/*
+ * Free high memory counts too: user pages mostly live there, and what
+ * is left in low memory is the kernel's, which swapping doesn't get back.
+ */
+static void kswapd(void)
+{
+	for (;;) {
+		while (nr_free_pages + nr_free_highpages < FREE_PAGES_HIGH) {
+			if (!swap_out())
+				break;		/* nothing left to take */
+			cond_resched();
+		}
+		sleep_on(&kswapd_wait);
+	}
+}
+
+void kswapd_init(void)
+{
+	int pid;
+
+	if ((pid = kernel_thread(kswapd)) < 0)
+		printk("Unable to start kswapd\n\r");
+	else
+		printk("kswapd started, pid %d\n\r",pid);
+}
+
+/*
+ * swapon(specialfile) - use a block device as swap space. It has to be
+ * one whose driver does whole-page requests (hd, ramdisk): the floppy
+ * driver only ever transfers one block.
+ */
+int sys_swapon(const char * specialfile)
+{
+	struct m_inode * inode;
+	char * bitmap;
+	int dev, i, j;
+
+	if (!suser())
+		return -EPERM;
+	if (swap_bitmap)
+		return -EBUSY;
+	if (!(inode = namei(specialfile)))
+		return -ENOENT;
+	dev = inode->i_zone[0];
+	i = S_ISBLK(inode->i_mode);
+	iput(inode);
+	if (!i)
+		return -ENOTBLK;
+	if (MAJOR(dev) == 2)
+		return -EINVAL;
+	if (!(bitmap = (char *) get_free_page()))
+		return -ENOMEM;
+	ll_rw_page(READ,dev,0,bitmap);
+	if (strncmp("SWAP-SPACE",bitmap+4086,10)) {
+		printk("Unable to find swap-space signature\n\r");
+		free_page((long) bitmap);
+		return -EINVAL;
+	}
+	memset(bitmap+4086,0,10);
+	j = 0;
+	for (i = 1 ; i < SWAP_BITS ; i++)
+		if (bit(bitmap,i))
+			j++;
+	if (bit(bitmap,0) || !j) {
+		printk("Bad swap-space bit-map\n\r");
+		free_page((long) bitmap);
+		return -EINVAL;
+	}
+	swap_dev = dev;
+	swap_bitmap = bitmap;
+	printk("Swap device %04x: %d pages (%dkB) of swap-space\n\r",dev,j,j*4);
+	return 0;
+}